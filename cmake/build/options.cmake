@@ -11,5 +11,6 @@ option(BUILD_TESTS        "Build testsuite"            OFF)
 option(DEBUG_LOGGER       "Enable extra debug logging" OFF)
 option(VERBOSE_TRACELOG   "Enable verbose trace logs"  OFF)
 option(DEBUG_HINTS        "Enable hints rendering"     OFF)
+option(ENABLE_TRACING     "Enable --trace"             OFF)
 
 # }}}
@@ -58,5 +58,6 @@ colored_option(STATUS " Build testsuite      ${BUILD_TESTS}" BUILD_TESTS "32;1"
 colored_option(STATUS " Debug logging        ${DEBUG_LOGGER}" DEBUG_LOGGER "32;1" "37;2")
 colored_option(STATUS " Verbose tracing      ${VERBOSE_TRACELOG}" VERBOSE_TRACELOG "32;1" "37;2")
 colored_option(STATUS " Draw debug hints     ${DEBUG_HINTS}" DEBUG_HINTS "32;1" "37;2")
+colored_option(STATUS " Event tracing        ${ENABLE_TRACING}" ENABLE_TRACING "32;1" "37;2")
 colored_option(STATUS " Enable ccache        ${ENABLE_CCACHE}" ENABLE_CCACHE "32;1" "37;2")
 message(STATUS "--------------------------")
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <condition_variable>
+
+#include "core/plugin_handler.hpp"
+#include "common.hpp"
+#include "downloader.hpp"
+#include "json.hpp"
+
+namespace bookwyrm {
+
+/*
+ * A frontend for when nobody is watching: no TUI, no keypresses. The best
+ * matches are chosen by score as they are found and downloaded right away,
+ * and everything that happens is written to stdout as one JSON object a line:
+ *
+ *   {"event":"queued","id":3,"score":91,"title":"...","authors":[...],"extension":"pdf"}
+ *   {"event":"progress","id":3,"dlnow":1048576,"dltotal":4194304,"rate":524288}
+ *   {"event":"done","id":3,"md5":"..."}
+ *
+ * and so on, with a final "finished" event.
+ *
+ * Hidden, as it holds on to the (hidden) plugin_handler.
+ */
+class __attribute__ ((visibility("hidden"))) batch : public core::frontend {
+public:
+    /* How often a running download's progress is reported. */
+    static constexpr std::chrono::seconds progress_interval{1};
+
+    /* WARN: this constructor should only be used in make_batch_with() below. */
+    explicit batch(core::plugin_handler &plugin_handler, downloader &downloader,
+            size_t best, int min_score, core::log_level min_level);
+
+    /* Called by the plugins and the downloader from their threads. */
+    void update() override;
+    void log(const core::log_level level, const string message) override;
+
+    /*
+     * Choose and download until the plugins are done and so is every chosen item.
+     * Returns true if something was chosen and all of it was downloaded (or already owned).
+     */
+    bool run();
+
+private:
+    core::plugin_handler &plugin_handler_;
+    downloader &downloader_;
+
+    /* Download at most best_ items, none scoring below min_score_. */
+    const size_t best_;
+    const int min_score_;
+    const core::log_level min_level_;
+
+    struct choice {
+        size_t id;
+        int score;
+
+        /* Already in the download directory, so there's nothing to download. */
+        bool owned;
+    };
+
+    vector<choice> chosen_;
+
+    /* How many results we have considered. */
+    size_t seen_ = 0;
+
+    /* What we last reported about each chosen job, and when. */
+    struct report {
+        download_job::status state;
+        std::chrono::steady_clock::time_point at;
+    };
+
+    std::unordered_map<size_t, report> reported_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool updated_ = false;
+
+    /* Events come from several threads; keep their lines whole. */
+    std::mutex output_mutex_;
+
+    /*
+     * Choose the item if it scores well enough and we have room for it. When we're full,
+     * it replaces the worst choice whose download hasn't started, if it scores better.
+     */
+    void consider(size_t id, const core::item &item);
+
+    /* Report state changes and progress of the chosen items. Returns true if all are finished. */
+    bool report_jobs();
+
+    void emit(json::object event);
+};
+
+/* Load the plugins, hook us up to them and the downloader, and start searching. */
+std::shared_ptr<batch> make_batch_with(core::plugin_handler &plugin_handler, downloader &downloader,
+        size_t best, int min_score, core::log_level min_level);
+
+/* ns bookwyrm */
+}
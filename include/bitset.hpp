@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bookwyrm {
+
+/*
+ * A bitset that grows with what it indexes. One bit per item, so that
+ * testing an item is a shift and a mask, and operations on every item
+ * run through 64 of them at a time.
+ */
+class bitset {
+public:
+    size_t size() const
+    {
+        return size_;
+    }
+
+    /* New bits are cleared. */
+    void resize(size_t size)
+    {
+        size_ = size;
+        words_.resize((size + word_bits - 1) / word_bits, 0);
+        clear_tail();
+    }
+
+    bool test(size_t i) const
+    {
+        return i < size_ && (words_[i / word_bits] >> (i % word_bits)) & 1;
+    }
+
+    /* i must be less than size(). */
+    void set(size_t i)
+    {
+        assert(i < size_);
+        words_[i / word_bits] |= word{1} << (i % word_bits);
+    }
+
+    void reset(size_t i)
+    {
+        assert(i < size_);
+        words_[i / word_bits] &= ~(word{1} << (i % word_bits));
+    }
+
+    void set_all()
+    {
+        for (auto &w : words_) w = ~word{0};
+        clear_tail();
+    }
+
+    void reset_all()
+    {
+        for (auto &w : words_) w = 0;
+    }
+
+    void flip_all()
+    {
+        for (auto &w : words_) w = ~w;
+        clear_tail();
+    }
+
+    size_t count() const
+    {
+        size_t n = 0;
+        for (const auto w : words_)
+            n += __builtin_popcountll(w);
+
+        return n;
+    }
+
+    bool none() const
+    {
+        for (const auto w : words_)
+            if (w) return false;
+
+        return true;
+    }
+
+    /* Call f with the index of every set bit, in order. */
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (size_t i = 0; i < words_.size(); i++) {
+            for (word w = words_[i]; w; w &= w - 1)
+                f(i * word_bits + __builtin_ctzll(w));
+        }
+    }
+
+    /*
+     * Call f(idx, now_set) for every bit that differs between us and other,
+     * as if going from other to us. Both must be of the same size.
+     */
+    template <typename F>
+    void for_each_change(const bitset &other, F f) const
+    {
+        for (size_t i = 0; i < words_.size(); i++) {
+            for (word w = words_[i] ^ other.words_[i]; w; w &= w - 1) {
+                const size_t idx = i * word_bits + __builtin_ctzll(w);
+                f(idx, test(idx));
+            }
+        }
+    }
+
+private:
+    using word = std::uint64_t;
+    static constexpr size_t word_bits = 64;
+
+    std::vector<word> words_;
+    size_t size_ = 0;
+
+    /* Bits past size_ are always cleared, so that count() and for_each() needn't care. */
+    void clear_tail()
+    {
+        if (const size_t used = size_ % word_bits; used != 0)
+            words_.back() &= (word{1} << used) - 1;
+    }
+};
+
+/* ns bookwyrm */
+}
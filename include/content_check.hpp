@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace bookwyrm {
+
+/*
+ * Mirrors like to answer with a 200 and an HTML page (an error, a captcha, an ad)
+ * instead of the file we asked for, which CURLOPT_FAILONERROR can't catch.
+ *
+ * Before anything is written, we look at the Content-Type and, if the transfer
+ * starts at the beginning of the file, at its first bytes: a PDF must start with
+ * "%PDF-", a DjVu with "AT&TFORM", etc. Until we know, the data is held back.
+ */
+class content_check {
+public:
+    enum class verdict { pending, plausible, implausible };
+
+    /* at_start: does the transfer begin at the first byte of the file? */
+    explicit content_check(string extension = "", bool at_start = false);
+
+    /*
+     * Look at the next chunk of the transfer, which is appended to head().
+     * content_type may be null if the mirror didn't send one.
+     */
+    verdict feed(const char *data, size_t len, const char *content_type);
+
+    /* The transfer ended before we could decide; judge by what we got. */
+    verdict finish();
+
+    verdict result() const
+    {
+        return verdict_;
+    }
+
+    /* What we held back so far; write it out once the verdict is plausible. */
+    string& head()
+    {
+        return head_;
+    }
+
+    /* Why the data was found implausible, for the log. */
+    const string& reason() const
+    {
+        return reason_;
+    }
+
+private:
+    /* Compare head_ against the extension's magic bytes, if we have enough of it. */
+    verdict judge(bool final);
+
+    string extension_;
+    bool at_start_;
+    bool type_checked_ = false;
+    verdict verdict_ = verdict::pending;
+    string head_, reason_;
+};
+
+/* ns bookwyrm */
+}
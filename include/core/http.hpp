@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <stdexcept>
+#include <curl/curl.h>
+
+namespace core {
+
+class http_error : public std::runtime_error {
+public:
+    explicit http_error(const std::string &message, long status = 0)
+        : runtime_error(message), status(status) {}
+
+    /* The HTTP response code, if the server answered with an error; 0 otherwise. */
+    long status{0};
+};
+
+/*
+ * A curl share handle for every transfer we make, be it a download or a
+ * plugin's request: DNS lookups, TLS sessions and open connections are
+ * reused between them instead of each transfer resolving and handshaking
+ * with the same mirrors all over again.
+ */
+class http_share {
+public:
+    explicit http_share();
+    ~http_share();
+
+    /* The share is passed around by pointer; there is only one of it. */
+    http_share(const http_share&) = delete;
+    http_share& operator=(const http_share&) = delete;
+
+    /* Let the handle use (and fill) the shared caches. */
+    void attach(CURL *handle);
+
+    /* Account for a finished transfer; call it before the handle is reset or cleaned up. */
+    void record(CURL *handle);
+
+    /* How many transfers were recorded, and how many new connections (handshakes) they needed. */
+    size_t transfers() const
+    {
+        return transfers_;
+    }
+
+    size_t connections() const
+    {
+        return connections_;
+    }
+
+private:
+    static void lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr);
+    static void unlock(CURL *handle, curl_lock_data data, void *userptr);
+
+    CURLSH *share_;
+
+    /* The share may be used from several threads at once; one lock per kind of data. */
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> locks_;
+
+    std::atomic<size_t> transfers_{0}, connections_{0};
+};
+
+/*
+ * Fetch the body of url, using the share if there is one.
+ * Throws http_error if the transfer fails, or on HTTP codes >= 400.
+ */
+std::string http_get(const std::string &url, http_share *share);
+
+/* ns core */
+}
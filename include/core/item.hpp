@@ -119,6 +119,12 @@ public:
      */
     bool matches(const item &wanted) const;
 
+    /*
+     * How well the item matches what's wanted, from 0 to 100: the mean of the fuzzy
+     * ratios of the wanted non-exact values. 100 if none were specified.
+     */
+    int score(const item &wanted) const;
+
     const nonexacts_t nonexacts;
     const exacts_t exacts;
     const misc_t misc;
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <map>
 #include <mutex>
+#include <chrono>
 #include <memory>
 #include <atomic>
 #include <thread>
 
+#include "http.hpp"
 #include "item.hpp"
 #include "python.hpp"
 
@@ -56,11 +59,54 @@ public:
     /* Try to add a found item, and then update the set frontend. */
     void add_item(std::tuple<core::nonexacts_t, core::exacts_t, core::misc_t> item_comps);
 
+    /*
+     * Log something to the frontend, from a plugin or from ourselves.
+     *
+     * A message that differs from its source's last one only in its numbers is folded
+     * into it: the repeats are counted and logged as one entry when another message
+     * comes, or every fold_interval. Each source may also log at most log_rate entries
+     * a second (log_burst at once); what's over the budget is dropped and counted.
+     */
     void log(log_level lvl, std::string msg);
 
-    vector<core::item>& results()
+    /* Log what's pending for this thread's source: its folded repeats and dropped count. */
+    void flush_log();
+
+    /*
+     * Fetch a page for a plugin. Unlike each plugin using its own HTTP library,
+     * this shares DNS lookups, TLS sessions and connections with the downloader.
+     */
+    std::string http_get(const std::string &url)
+    {
+        return core::http_get(url, http_.get());
+    }
+
+    void set_http_share(std::shared_ptr<http_share> share)
+    {
+        http_ = share;
+    }
+
+    /* A copy of the results found since the first'th one, safe to take while plugins run. */
+    vector<core::item> results_from(size_t first)
+    {
+        std::lock_guard<std::mutex> guard(items_mutex_);
+        if (first >= items_.size()) return {};
+        return {items_.cbegin() + first, items_.cend()};
+    }
+
+    /*
+     * Are any plugins still looking? Once this is false, all results are in.
+     * The frontend is updated as each plugin finishes.
+     */
+    bool searching() const
     {
-        return items_;
+        return searching_ > 0;
+    }
+
+    /* What the user asked for; results are scored against it. */
+    const core::item& wanted() const
+    {
+        return wanted_;
     }
 
     /* What frontend do we want to notify on updates? */
@@ -84,9 +130,40 @@ private:
     /* The same Python modules, but now running! */
     vector<std::thread> threads_;
 
+    /* How many of them have yet to return. */
+    std::atomic<size_t> searching_{0};
+
     std::weak_ptr<frontend> frontend_;
 
+    std::shared_ptr<http_share> http_;
+
     vector<py::module> plugins_;
+
+    /* The log state of a plugin; see log(). */
+    struct log_source {
+        /* The last message logged, its level and its shape (numbers replaced). */
+        std::string last, shape;
+        log_level level = log_level::off;
+
+        /* How many times it has been repeated since we last said so, and when we last did. */
+        size_t repeats = 0;
+        std::chrono::steady_clock::time_point folded_since;
+
+        /* Token bucket. */
+        double budget = log_burst;
+        std::chrono::steady_clock::time_point refilled = std::chrono::steady_clock::now();
+        size_t dropped = 0;
+    };
+
+    static constexpr double log_rate = 10, log_burst = 50;
+    static constexpr std::chrono::seconds fold_interval{5};
+
+    /* By plugin name; empty for ourselves. */
+    std::map<std::string, log_source> log_sources_;
+    std::mutex log_mutex_;
+
+    /* Which plugin is running on this thread, if any. */
+    static thread_local std::string plugin_name_;
 };
 
 /* ns butler */
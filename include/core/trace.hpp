@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <ostream>
+#include <algorithm>
+#include <string_view>
+
+/*
+ * Where a search spends its time: plugins, feeds, matching, the GIL, repaints
+ * and downloads are recorded as spans into a ring buffer per thread, and written
+ * out as a Chrome trace (chrome://tracing, or ui.perfetto.dev) with --trace.
+ *
+ * Only compiled in with -DENABLE_TRACING=ON (which defines BOOKWYRM_TRACING);
+ * otherwise every span and call here is a no-op the compiler removes. When
+ * compiled in, recording costs a relaxed load until start() is called.
+ *
+ * The pybookwyrm module links its own copy of core, so these are exported,
+ * and the executable exports its own (see src/CMakeLists.txt): the module's
+ * spans are then recorded into the executable's buffers, not a copy of them.
+ */
+namespace core::trace {
+
+#ifdef BOOKWYRM_TRACING
+constexpr bool compiled_in = true;
+#else
+constexpr bool compiled_in = false;
+#endif
+
+using clock = std::chrono::steady_clock;
+
+namespace detail {
+
+/* How long a recorded name and detail may be, their terminators included. */
+constexpr size_t name_size = 48, detail_size = 64;
+
+extern std::atomic<bool> recording __attribute__ ((visibility("default")));
+
+/* Copied, and cut short if need be, but not in the middle of a UTF-8 character. */
+template <size_t N>
+inline void copy_into(std::array<char, N> &dst, std::string_view src)
+{
+    size_t n = std::min(src.size(), N - 1);
+    while (n > 0 && n < src.size() && (static_cast<unsigned char>(src[n]) & 0xc0) == 0x80)
+        n--;
+
+    std::memcpy(dst.data(), src.data(), n);
+    dst[n] = '\0';
+}
+
+__attribute__ ((visibility("default")))
+void record(const char *category, std::string_view name, std::string_view detail,
+        clock::time_point begin, clock::time_point end);
+
+/* ns detail */
+}
+
+/* Are we recording? Cheap enough to ask before every event. */
+inline bool enabled()
+{
+    if constexpr (compiled_in)
+        return detail::recording.load(std::memory_order_relaxed);
+    else
+        return false;
+}
+
+/* Start recording. Each thread keeps its last ring_capacity events. */
+__attribute__ ((visibility("default"))) void start();
+
+/* What the calling thread is called in the trace; "thread N" by default. */
+__attribute__ ((visibility("default"))) void name_thread(const std::string &name);
+
+/* Write everything recorded so far as a Chrome trace. */
+__attribute__ ((visibility("default"))) void write_chrome_trace(std::ostream &os);
+
+/* Something that happened at a point in time, e.g. the first byte of a download. */
+inline void instant(const char *category, std::string_view name, std::string_view detail = {})
+{
+    if (enabled()) {
+        const auto now = clock::now();
+        detail::record(category, name, detail, now, now);
+    }
+}
+
+/*
+ * Something that takes time: recorded from construction to destruction.
+ * The category must be a string literal; the name and detail are copied into
+ * the span itself, so that neither it nor recording it allocates.
+ */
+class span {
+public:
+    explicit span(const char *category, std::string_view name, std::string_view detail = {})
+    {
+        if (!enabled())
+            return;
+
+        category_ = category;
+        detail::copy_into(name_, name);
+        detail::copy_into(detail_, detail);
+        begin_ = clock::now();
+    }
+
+    ~span()
+    {
+        if (category_)
+            detail::record(category_, name_.data(), detail_.data(), begin_, clock::now());
+    }
+
+    span(const span&) = delete;
+    span& operator=(const span&) = delete;
+
+    /* How it went, e.g. whether an item matched; known only at the end. */
+    void set_detail(std::string_view detail)
+    {
+        if (category_)
+            detail::copy_into(detail_, detail);
+    }
+
+private:
+    /* Null unless we were recording when constructed. */
+    const char *category_ = nullptr;
+    std::array<char, detail::name_size> name_;
+    std::array<char, detail::detail_size> detail_;
+    clock::time_point begin_;
+};
+
+/* Records from construction, and writes the trace to path on destruction. */
+class session {
+public:
+    explicit session(const std::string &path);
+    ~session();
+
+    session(const session&) = delete;
+    session& operator=(const session&) = delete;
+
+private:
+    const std::string path_;
+};
+
+/* ns core::trace */
+}
@@ -1,10 +1,29 @@
+#pragma once
+
 #include <curl/curl.h>
 #include <iostream>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <condition_variable>
 #include <experimental/filesystem>
 
 #include "common.hpp"
+#include "content_check.hpp"
+#include "file_writer.hpp"
+#include "hash.hpp"
 #include "item.hpp"
+#include "journal.hpp"
+#include "library.hpp"
+#include "mirror_stats.hpp"
 #include "time.hpp"
+#include "token_bucket.hpp"
+#include "core/http.hpp"
+#include "core/plugin_handler.hpp"
 
 namespace fs = std::experimental::filesystem;
 
@@ -26,28 +45,360 @@ private:
     const bool use_unicode_, use_colour_;
 };
 
+/*
+ * In which order queued jobs are downloaded. Regardless of the policy,
+ * jobs the user has given a higher priority go first.
+ */
+enum class queue_policy {
+    fifo,      /* in the order they were queued */
+    smallest,  /* smallest items first, so that most of them land early; unknown sizes last */
+    hosts,     /* take turns between the hosts the items are downloaded from */
+};
+
+/* What a mirror tells us about an item before we download it. */
+struct remote_info {
+    /* Did the mirror answer at all? */
+    bool reachable = false;
+
+    curl_off_t length = -1;
+    bool accepts_ranges = false;
+
+    /* Used to tell whether a partial download is still the same file. */
+    string etag;
+
+    /* Seconds until the first byte of the answer; roughly the mirror's latency. */
+    double ttfb = -1;
+};
+
+/* An item queued for download, and how far along it is. */
+struct download_job {
+    enum class status { queued, downloading, done, failed, cancelled };
+
+    explicit download_job(size_t id, const core::item &item)
+        : id(id), item(item) {}
+
+    /* Identifies the job to the frontend, e.g. the item's index in the menu. */
+    const size_t id;
+    const core::item item;
+
+    std::atomic<status> state{status::queued};
+
+    /* Set by the user; higher goes first. */
+    std::atomic<int> priority{0};
+
+    /*
+     * What each of the item's mirrors told us, and when we asked.
+     * Only touched by the downloader's worker.
+     */
+    vector<remote_info> mirrors;
+    bool probed = false;
+    std::chrono::steady_clock::time_point probed_at;
+
+    /* In bytes and bytes per second; dltotal is 0 until the mirror tells us. */
+    std::atomic<curl_off_t> dlnow{0}, dltotal{0};
+    std::atomic<double> rate{0};
+
+    /*
+     * Hashes of the downloaded file, computed while it was written.
+     * Only valid once state is done.
+     */
+    string md5, sha256;
+};
+
 class downloader {
 public:
-    explicit downloader(string download_dir);
+    /* All transfers use the share, if given, to reuse lookups, TLS sessions and connections. */
+    explicit downloader(string download_dir, std::shared_ptr<core::http_share> share = nullptr);
+
+    /* Cancels all unfinished jobs and waits for the worker to stop. */
     ~downloader();
 
+    /*
+     * Queue an item for download in the background. Queueing an id that is
+     * already queued, downloading or done does nothing; a cancelled or failed
+     * job is retried.
+     */
+    void async_download(size_t id, const core::item &item);
+
+    /* Queue items[id] for each of the ids, all under one lock; ids past the items are ignored. */
+    void async_download(const vector<size_t> &ids, const vector<core::item> &items);
+
+    /* Cancel the job with the given id. A partial download is kept for resuming. */
+    void cancel(size_t id);
+    void cancel(const vector<size_t> &ids);
+    void cancel_all();
+
+    /*
+     * Block until all queued jobs are done.
+     * Returns true if at least one item was downloaded.
+     */
+    bool wait();
+
     /*
      * Downloads the given items in a blocking, synchronous order.
      * Returns true if at least one item was downloaded.
      */
     bool sync_download(vector<core::item> items);
 
+    /* The files in the download directory. */
+    const library& local_library() const
+    {
+        return library_;
+    }
+
+    /* A snapshot of all jobs, in the order they were queued. */
+    vector<std::shared_ptr<const download_job>> jobs() const;
+
+    void set_policy(queue_policy policy)
+    {
+        std::lock_guard<std::mutex> guard(jobs_mutex_);
+        policy_ = policy;
+    }
+
+    /* Raise (or, if negative, lower) the priority of the job with the given id. */
+    void change_priority(size_t id, int delta);
+
+    /*
+     * Limit the combined download rate of all transfers, in bytes per second.
+     * 0 (the default) means unlimited.
+     */
+    void set_rate_limit(std::int64_t rate)
+    {
+        bucket_.set_rate(rate);
+    }
+
+    /*
+     * Limit how many connections a download opens to a single host;
+     * segments beyond that wait for a free connection. 0 means unlimited.
+     */
+    void set_max_host_connections(size_t max)
+    {
+        max_host_connections_ = max;
+    }
+
+    /*
+     * While a frontend is set, progress and errors are reported to it
+     * instead of being printed on the terminal.
+     */
+    void set_frontend(std::shared_ptr<core::frontend> fe)
+    {
+        frontend_ = fe;
+    }
+
+    /* For other HTTP clients to share connections with our transfers. */
+    std::shared_ptr<core::http_share> http_share() const
+    {
+        return share_;
+    }
+
     time::timer timer;
     progressbar pbar;
 
 private:
+    /* A byte range of an item, fetched in its own transfer. */
+    struct segment {
+        CURL *handle = nullptr;
+
+        /* Shared by all segments; also hashes the file. */
+        file_writer *writer = nullptr;
+
+        /* Shared by all transfers. */
+        token_bucket *bucket = nullptr;
+
+        /* Next byte to receive and the last byte (inclusive) of the range. */
+        curl_off_t offset, end;
+
+        /* Where the range starts, for progress metering. */
+        curl_off_t start;
+
+        /* Index of the mirror we are currently fetching the range from. */
+        size_t mirror;
+
+        /* Where the current transfer of the range began, for the mirror's statistics. */
+        curl_off_t from;
+
+        /* Has the mirror acknowledged the range with a 206? */
+        bool validated = false;
+
+        /* Is the mirror sending us what we asked for? */
+        content_check check;
+    };
+
+    /* Where a single stream writes its data. */
+    struct stream {
+        CURL *handle;
+        file_writer *writer;
+        token_bucket *bucket;
+        content_check check;
+
+        /* Next byte to receive. */
+        curl_off_t offset;
+
+        /* Kept up to date with what is on disk, at most a second behind. */
+        journal *jrnl;
+        fs::path jpath;
+        time::timer since_journal;
+    };
+
     static int progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+    static size_t header_callback(char *buffer, size_t size, size_t nitems, void *userdata);
+    static size_t segment_write_callback(char *data, size_t size, size_t nmemb, void *userdata);
+    static size_t stream_write_callback(char *data, size_t size, size_t nmemb, void *userdata);
+
+    /*
+     * Pass received data through the content check to the writer, advancing offset
+     * by what was written. Returns false if the transfer should be aborted.
+     */
+    static bool deliver(CURL *handle, content_check &check, file_writer &writer,
+            curl_off_t &offset, const char *data, size_t len);
+
+    /*
+     * Write what the check held back, once it has been found plausible; also
+     * called when a transfer ends before the check could decide.
+     * Returns false if the data is implausible or couldn't be written.
+     */
+    static bool flush(content_check &check, file_writer &writer, curl_off_t &offset);
+
+    /*
+     * Finish the digest and compare it with the item's MD5, if we know it.
+     * On a match, the hashes are stored in the current job.
+     */
+    bool verify(hash::digest &digest, const string &expected_md5);
+
+    /* Create an easy handle with the options shared by all our transfers. */
+    CURL* make_handle();
+
+    /* Account for a finished transfer in the share's statistics. */
+    void record(CURL *handle)
+    {
+        if (share_) share_->record(handle);
+    }
+
+    /*
+     * Ask all mirrors at once for the item's length, whether they serve byte
+     * ranges and how long they take to answer. Returns one info per URL.
+     */
+    vector<remote_info> probe(const vector<string> &urls);
+
+    /*
+     * Probe the mirrors of all given jobs in one go, so that their sizes are
+     * known (and shown) before they are downloaded, and warn if they won't fit.
+     */
+    void probe_jobs(const vector<std::shared_ptr<download_job>> &jobs);
+
+    /* How a segmented download ended. */
+    enum class segmented_result {
+        done,
+
+        /* Some ranges arrived; they are kept in the .part file and its journal for the next attempt. */
+        partial,
+
+        /* Nothing was kept (or there was nothing to segment); try a single stream instead. */
+        fall_back
+    };
+
+    /*
+     * Split the transfer into byte ranges fetched in parallel, spread out over
+     * all mirrors that serve ranges for the same item. Falls back without
+     * touching the disk if the item is too small or no mirror supports ranges.
+     *
+     * Data is written to filename's .part file. Progress is kept in its journal,
+     * and if a matching journal is passed, the remaining ranges are resumed.
+     */
+    segmented_result segmented_download(const vector<string> &uris, const vector<remote_info> &infos,
+            const fs::path &filename, const std::optional<journal> &resume, const string &md5);
+
+    /*
+     * Try each mirror in turn with a single stream, appending to the .part
+     * file if the journal says we were interrupted while reading from it.
+     *
+     * Both kinds of downloads hash the data as it is written and fail over
+     * if it doesn't match the expected MD5 (if not empty).
+     */
+    bool single_download(const vector<string> &uris, const vector<remote_info> &infos,
+            const fs::path &filename, const std::optional<journal> &resume, const string &md5);
+
+    /* Download a single item; returns true on success. */
+    bool download(download_job &job);
+
+    /* At most how many jobs' mirrors are probed between two downloads. */
+    static constexpr size_t max_probed_jobs = 16;
+
+    /* Pops queued jobs and downloads them, one at a time. */
+    void work();
+
+    /*
+     * Queue a job, or requeue it if it was cancelled or failed. jobs_mutex_ must be held.
+     * Returns true if there is something new to download.
+     */
+    bool enqueue(size_t id, const core::item &item);
+
+    /* Cancel a job, if it is queued or downloading. jobs_mutex_ must be held. */
+    void cancel_job(size_t id);
+
+    /* Returns the next queued job according to policy_, if any. jobs_mutex_ must be held. */
+    std::shared_ptr<download_job> next_job() const;
+
+    /* Has the user given up on the job we're currently downloading? */
+    bool cancelled() const
+    {
+        return current_ && current_->state == download_job::status::cancelled;
+    }
+
+    /*
+     * Update the current job's progress and, at most every 100ms, tell the
+     * frontend or draw the progress bar on the terminal.
+     */
+    void report_progress(curl_off_t dltotal, curl_off_t dlnow, double rate, bool force = false);
+
+    /* Draw the progress bar and transfer statistics on the current line. */
+    void draw_progress(curl_off_t dltotal, curl_off_t dlnow, double rate);
+
+    /* Log to the frontend if there is one; otherwise print to stderr. */
+    void log(core::log_level lvl, const string &msg);
+
+    /* The host (and port, if any) part of the URL. */
+    static string host_of(const string &url);
 
     /* Generates a relative filename in dldir to save the given item. */
     fs::path generate_filename(const core::item &item);
 
     const fs::path dldir;
+    const std::shared_ptr<core::http_share> share_;
+
+    /* What is in dldir already. */
+    library library_;
     CURL *curl;
+
+    /* The job the worker is currently downloading. */
+    download_job *current_ = nullptr;
+
+    /* How much of the current single stream we got during an earlier attempt. */
+    curl_off_t resumed_from_ = 0;
+
+    /* In the order they were queued, and by id. */
+    vector<std::shared_ptr<download_job>> jobs_;
+    std::unordered_map<size_t, std::shared_ptr<download_job>> jobs_by_id_;
+    mutable std::mutex jobs_mutex_;
+    std::condition_variable jobs_cv_;
+    bool stop_ = false;
+
+    queue_policy policy_ = queue_policy::fifo;
+
+    /* For queue_policy::hosts: when we last started a job from each host. */
+    std::map<string, size_t> host_turns_;
+    size_t turn_ = 0;
+
+    std::weak_ptr<core::frontend> frontend_;
+
+    token_bucket bucket_;
+
+    /* How the hosts have been doing, this run and earlier ones. */
+    mirror_stats stats_;
+    std::atomic<size_t> max_host_connections_{4};
+
+    /* Declared last, so that everything it touches is constructed before it starts. */
+    std::thread worker_;
 };
 
 }
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <condition_variable>
+#include <experimental/filesystem>
+
+#include "common.hpp"
+#include "item.hpp"
+#include "core/http.hpp"
+
+namespace fs = std::experimental::filesystem;
+
+namespace bookwyrm {
+
+/* What we know about an item beyond what the plugins told us. */
+struct item_info {
+    string description;
+    vector<string> subjects;
+    int pages = 0;
+};
+
+/*
+ * Looks up an item's description, subjects and page count on Open Library,
+ * on a background thread, so that a detail screen opens without waiting.
+ *
+ * Lookups are keyed by ISBN, or by title if the item has none. Results are
+ * kept in an in-memory LRU cache and, gzipped, one file per key in the cache
+ * directory, so that an item is looked up on the network only once. So are
+ * misses; only network errors aren't kept, to be tried again later.
+ */
+class enricher {
+public:
+    static constexpr const char *default_url = "https://openlibrary.org";
+    static constexpr size_t default_capacity = 512;
+
+    enum class status { unknown, pending, found, not_found };
+
+    /* $XDG_CACHE_HOME/bookwyrm/details, or ~/.cache/bookwyrm/details. */
+    static fs::path default_cache_dir();
+
+    explicit enricher(std::shared_ptr<core::http_share> share = nullptr, string base_url = default_url,
+            fs::path cache_dir = default_cache_dir(), size_t capacity = default_capacity);
+    ~enricher();
+
+    /* "isbn:<first ISBN>", or "title:<title>" in lower case. */
+    static string key_of(const core::item &item);
+
+    /* Look the item up before any prefetches. */
+    void request(const core::item &item);
+
+    /*
+     * Look the item up once nothing more urgent is queued; the user may be about to
+     * open it. Only the last few prefetches are kept.
+     */
+    void prefetch(const core::item &item);
+
+    /* What we know about the item so far; the info is empty unless status::found. */
+    std::pair<status, item_info> get(const core::item &item);
+
+    /* Called on the lookup thread whenever a lookup finishes. */
+    void set_callback(std::function<void()> callback)
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        callback_ = callback;
+    }
+
+private:
+    static constexpr size_t max_prefetches = 8;
+
+    /* Queue the item's key as a request or a prefetch. */
+    void enqueue(const core::item &item, bool urgent);
+
+    void work();
+
+    /* Look the key up on the network. std::nullopt if there's no such item. */
+    std::optional<item_info> fetch(const string &key);
+
+    /* Read and write the on-disk cache, misses included. */
+    std::optional<std::pair<status, item_info>> load(const string &key) const;
+    void save(const string &key, const std::pair<status, item_info> &result) const;
+    fs::path path_of(const string &key) const;
+
+    /* Remember the result, evicting the least recently used one if we're full. */
+    void remember(const string &key, status st, item_info info);
+
+    const std::shared_ptr<core::http_share> share_;
+    const string base_url_;
+    const fs::path cache_dir_;
+    const size_t capacity_;
+
+    /* Most recently used first. */
+    using lru_list = std::list<std::pair<string, std::pair<status, item_info>>>;
+    lru_list lru_;
+    std::unordered_map<string, lru_list::iterator> cache_;
+
+    /* Queued, and all that's queued or being looked up. */
+    std::deque<string> requests_, prefetches_;
+    std::unordered_set<string> pending_;
+
+    std::function<void()> callback_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+
+    std::thread worker_;
+};
+
+/* ns bookwyrm */
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <condition_variable>
+
+#include "common.hpp"
+#include "hash.hpp"
+
+namespace bookwyrm {
+
+/*
+ * Writes a download to disk on its own thread, so that the thread receiving
+ * the data never waits on the disk (unless it gets far ahead of it).
+ *
+ * Incoming data is gathered into large, page-aligned buffers, one per
+ * contiguous stream of writes (e.g. one per segment), and a full buffer is
+ * handed to the writer thread, which pwrites it and hashes the file in order.
+ */
+class file_writer {
+public:
+    using range = std::pair<std::int64_t, std::int64_t>;
+
+    /*
+     * Write to (but don't take ownership of) fd, hashing the file into digest.
+     * The [start, end) ranges in existing are already on disk from an earlier
+     * attempt; those are read back once, and only for hashing.
+     */
+    explicit file_writer(int fd, hash::digest &digest, const vector<range> &existing = {});
+    ~file_writer();
+
+    /* Reserve length bytes for the file so that it doesn't fragment. */
+    static bool preallocate(int fd, std::int64_t length);
+
+    /*
+     * Queue data to be written at offset. Only blocks if all buffers are
+     * waiting for the disk. Returns false if an earlier write failed.
+     */
+    bool write(const char *data, size_t len, std::int64_t offset);
+
+    /*
+     * Write everything still queued and stop the writer thread; may be called again.
+     * Returns false if anything failed to be written or hashed.
+     */
+    bool finish();
+
+    /* How far from the given offset is the file continuously written to disk? */
+    std::int64_t written_until(std::int64_t from) const;
+
+    /* How many bytes from the start of the file have been hashed? */
+    std::int64_t hashed() const
+    {
+        return hashed_;
+    }
+
+private:
+    struct buffer {
+        char *data;
+        size_t len;
+        std::int64_t offset;
+    };
+
+    static constexpr size_t buffer_size = 1024 * 1024,
+                            max_buffers = 16,
+                            max_open    = 8;
+
+    void work();
+
+    /* Take a free buffer, allocating one if we're below max_buffers. */
+    char* acquire();
+
+    /* Hand a buffer to the writer thread. */
+    void submit(const buffer &buf);
+
+    /* Record that [start, end) is on disk. mutex_ must be held. */
+    void mark_written(std::int64_t start, std::int64_t end);
+
+    /* Hash everything written continuously after what we've hashed so far. */
+    bool catch_up(const buffer *buf = nullptr);
+
+    const int fd_;
+    hash::digest &digest_;
+
+    /* Buffers being filled, touched only by the thread calling write(). */
+    vector<buffer> open_;
+
+    /* Buffers waiting to be written, and buffers free for reuse. */
+    std::deque<buffer> full_;
+    vector<char*> free_;
+    size_t allocated_ = 0;
+
+    /* Ranges of the file that are on disk, merged: start -> end. */
+    std::map<std::int64_t, std::int64_t> written_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<std::int64_t> hashed_{0};
+    std::atomic<bool> failed_{false};
+    bool stop_ = false;
+
+    std::thread thread_;
+};
+
+/* ns bookwyrm */
+}
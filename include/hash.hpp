@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+#include "common.hpp"
+
+namespace bookwyrm::hash {
+
+/*
+ * Incremental hash functions, fed with data as it arrives so that
+ * a downloaded file never has to be read back to be verified.
+ */
+
+class md5 {
+public:
+    explicit md5();
+
+    void update(const char *data, size_t len);
+
+    /* Finish the hash and return it in lowercase hex. Call only once. */
+    string hexdigest();
+
+private:
+    void transform(const uint8_t *block);
+
+    std::array<uint32_t, 4> state_;
+    std::array<uint8_t, 64> buffer_;
+    uint64_t length_ = 0;
+};
+
+class sha256 {
+public:
+    explicit sha256();
+
+    void update(const char *data, size_t len);
+
+    /* Finish the hash and return it in lowercase hex. Call only once. */
+    string hexdigest();
+
+private:
+    /* Process a number of 64-byte blocks; uses the SHA extensions when built with them. */
+    void transform(const uint8_t *blocks, size_t count);
+
+    std::array<uint32_t, 8> state_;
+    std::array<uint8_t, 64> buffer_;
+    uint64_t length_ = 0;
+};
+
+/* Both of the above, fed at once. */
+struct digest {
+    void update(const char *data, size_t len)
+    {
+        md5.update(data, len);
+        sha256.update(data, len);
+    }
+
+    hash::md5 md5;
+    hash::sha256 sha256;
+};
+
+/*
+ * LibGen embeds an item's MD5 in its download URLs (as ?md5=<hash> or /md5/<hash>).
+ * Returns the first such hash found among the given URLs in lowercase, or an empty string.
+ */
+string md5_from_urls(const vector<string> &urls);
+
+/* ns hash */
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <experimental/filesystem>
+
+#include "common.hpp"
+
+namespace fs = std::experimental::filesystem;
+
+namespace bookwyrm {
+
+/*
+ * A small record of an unfinished download, kept next to its <name>.part file,
+ * from which a later attempt can resume the transfer instead of starting over.
+ */
+struct journal {
+    /* A byte range of the item: where it starts, the next byte to fetch and its last byte. */
+    struct range {
+        std::int64_t start, offset, end;
+
+        bool done() const
+        {
+            return offset > end;
+        }
+    };
+
+    /* The mirror we last downloaded from, and what it called the file. */
+    string url, etag;
+
+    /* The item's full length in bytes, if known. */
+    std::int64_t length = -1;
+
+    /* How far a single stream got; the .part file is written from here on. */
+    std::int64_t offset = 0;
+
+    /* The remaining ranges of a segmented download; empty for a single stream. */
+    vector<range> ranges;
+
+    /* Returns std::nullopt if the journal doesn't exist or is malformed. */
+    static std::optional<journal> read(const fs::path &path);
+
+    /* Atomically replace the journal at path with this one. */
+    void write(const fs::path &path) const;
+};
+
+/* Where do we write an item while it is being downloaded? */
+inline fs::path part_path(const fs::path &filename)
+{
+    return fs::path(filename).concat(".part");
+}
+
+inline fs::path journal_path(const fs::path &filename)
+{
+    return fs::path(filename).concat(".part.journal");
+}
+
+/* ns bookwyrm */
+}
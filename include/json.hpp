@@ -0,0 +1,43 @@
+#pragma once
+
+#include <map>
+#include <variant>
+
+#include "common.hpp"
+#include "errors.hpp"
+
+/*
+ * Just enough JSON to read what web APIs answer with, and to write it back.
+ * Lookups never throw: a missing member or element is a null value, and
+ * asking a value for a type it isn't gives the fallback.
+ */
+namespace json {
+
+struct value;
+using array  = vector<value>;
+using object = std::map<string, value>;
+
+struct value {
+    std::variant<std::nullptr_t, bool, double, string, array, object> v;
+
+    bool is_null() const { return std::holds_alternative<std::nullptr_t>(v); }
+
+    /* Member key of an object, element idx of an array. */
+    const value& operator[](const string &key) const;
+    const value& operator[](size_t idx) const;
+
+    string str(const string &fallback = "") const;
+    double number(double fallback = 0) const;
+
+    /* The elements of an array; none if it isn't one. */
+    const array& elements() const;
+};
+
+/* Throws value_error on malformed input. */
+value parse(const string_view &text);
+
+/* The value as compact JSON. */
+string dump(const value &val);
+
+/* ns json */
+}
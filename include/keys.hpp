@@ -67,6 +67,12 @@ struct event {
  */
 bool poll_event(event &ev);
 
+/*
+ * Same as above, but give up after timeout milliseconds.
+ * Returns 0 on timeout, -1 on error and a positive value otherwise.
+ */
+int peek_event(event &ev, int timeout);
+
 /* ns keys */
 }
 
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <set>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <experimental/filesystem>
+
+#include "common.hpp"
+#include "item.hpp"
+
+namespace fs = std::experimental::filesystem;
+
+namespace bookwyrm {
+
+/*
+ * An index of the download directory: what we already own, so that we
+ * neither download it again nor probe the disk for free filenames.
+ *
+ * Each file's MD5 is kept in an index in the cache directory (one per download
+ * directory) together with its size and modification time. Rescanning the
+ * directory only looks at sizes and times; new or changed files are hashed in
+ * the background, and are only matched by MD5 once they have been. Authors,
+ * title and year are parsed from names on the form downloader::generate_filename
+ * gives them.
+ */
+class library {
+public:
+    struct entry {
+        string filename;
+        std::int64_t size, mtime;
+        string md5;
+
+        /* Empty if the name isn't on the form "authors - title (year).ext". */
+        string key;
+    };
+
+    /* Loads the index, and scans the directory and hashes what's new in the background. */
+    explicit library(fs::path dir);
+    ~library();
+
+    /* Bring the index up to date with the directory. Only sizes and times are looked at; nothing is hashed. */
+    void refresh();
+
+    /*
+     * Do we already have the item? Matched by MD5 if its URIs tell us
+     * (as LibGen's do), otherwise by authors, title, year and extension.
+     */
+    std::optional<entry> find(const core::item &item) const;
+
+    bool owns(const core::item &item) const
+    {
+        return find(item).has_value();
+    }
+
+    /* Is there a file (finished or not) by this name in the directory? */
+    bool taken(const string &filename) const;
+
+    /* Index a file we just put there ourselves, whose MD5 we know already. */
+    void add(const fs::path &path, const string &md5);
+
+    /* Bumped whenever what we own may have changed, so that a frontend knows when to redraw. */
+    size_t generation() const
+    {
+        return generation_;
+    }
+
+    /* The key an item would have; see entry::key. */
+    static string key_of(const string &authors, const string &title, int year, const string &extension);
+
+private:
+    /* $XDG_CACHE_HOME/bookwyrm/libraries/<MD5 of the directory's path>, or empty if there's no cache. */
+    static fs::path index_path(const fs::path &dir);
+
+    /* Read and write the index; only hashed files are written. */
+    void load();
+    void save() const;
+
+    /* Hash the files that are new or changed since they were last hashed. */
+    void hash_pending();
+
+    /* Rebuild by_md5_ and by_key_ from entries_. mutex_ must be held. */
+    void reindex();
+
+    const fs::path dir_, index_path_;
+
+    /* By filename. */
+    std::map<string, entry> entries_;
+
+    /* Filenames by MD5 and by key, so that find() needn't look through every entry. */
+    std::unordered_map<string, string> by_md5_, by_key_;
+
+    /* Every name in the directory, including the ones we don't index. */
+    std::set<string> names_;
+
+    mutable std::mutex mutex_;
+
+    /* Only one scan at a time. */
+    std::mutex refresh_mutex_;
+
+    /* Set when we're destructed; an unfinished scan is then thrown away. */
+    std::atomic<bool> stop_{false};
+
+    std::atomic<size_t> generation_{0};
+
+    std::thread scanner_;
+};
+
+/* ns bookwyrm */
+}
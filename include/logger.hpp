@@ -1,8 +1,10 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <memory>
 #include <ostream>
-#include <mutex>
+#include <algorithm>
 
 #include <spdlog/sinks/sink.h>
 #include <spdlog/details/log_msg.h>
@@ -17,9 +19,14 @@ namespace bookwyrm { class tui; }
 namespace logger {
 
 /*
- * A sink which stores all logs in a buffer. Can be flushed to a screen butler
- * on command. If buffer_ is non-empty on object destruction, buffer content is
- * written to std{out,err}.
+ * A sink which queues all logs until they are flushed to the log screen, which
+ * the TUI does on every repaint. Entries are unread until the TUI says they've been
+ * seen; those never flushed, and those the TUI hands back unseen, are written to
+ * std{out,err} on object destruction.
+ *
+ * Any thread may log; only the TUI's thread may flush. Logging never blocks and
+ * never paints: the entry is pushed onto a lock-free queue, and the TUI is asked
+ * to repaint, so that it may show the unread entries in its footer.
  */
 class bookwyrm_sink : public spdlog::sinks::sink {
 public:
@@ -33,20 +40,53 @@ public:
         tui_ = tui;
     }
 
-    /* Flush all unseen logs (content of buffer_) to the log screen. */
-    void flush_to_screen();
+    /* Flush all queued logs to the log screen. Returns how many there were. */
+    size_t flush_to_screen();
+
+    /* Everything logged so far has been seen. */
+    void mark_read()
+    {
+        for (auto &count : unread_)
+            count = 0;
+    }
+
+    /* An entry flushed to the screen but never looked at; written out, before the queue, on destruction. */
+    void keep_unseen(spdlog::level::level_enum level, string msg)
+    {
+        unseen_.push_back({level, std::move(msg)});
+    }
 
     bool has_unread_logs() const
     {
-        return !buffer_.empty();
+        return std::any_of(unread_.cbegin(), unread_.cend(), [](const auto &count) {
+            return count > 0;
+        });
     }
 
     spdlog::level::level_enum worst_unread() const;
 
 private:
-    using buffer_pair = std::pair<spdlog::level::level_enum, const string>;
-    vector<buffer_pair> buffer_;
-    std::mutex write_mutex_;
+    struct node {
+        spdlog::level::level_enum level;
+        string msg;
+        node *next;
+    };
+
+    /*
+     * The queue is a stack: producers push onto head_, and the consumer takes
+     * the whole stack at once and reverses it, which gives the entries back in
+     * the order they were pushed.
+     */
+    std::atomic<node*> head_{nullptr};
+
+    /* Take everything queued, oldest first. */
+    node* take();
+
+    /* How many entries of each level have been logged since mark_read(). */
+    std::array<std::atomic<size_t>, spdlog::level::off + 1> unread_{};
+
+    /* Only touched by the TUI's thread, and on destruction. */
+    vector<std::pair<spdlog::level::level_enum, string>> unseen_;
 
     std::weak_ptr<bookwyrm::tui> tui_;
 };
@@ -61,9 +101,19 @@ public:
         sink_->set_tui(butler);
     }
 
-    void flush_to_screen()
+    size_t flush_to_screen()
+    {
+        return sink_->flush_to_screen();
+    }
+
+    void mark_read()
+    {
+        sink_->mark_read();
+    }
+
+    void keep_unseen(spdlog::level::level_enum level, string msg)
     {
-        sink_->flush_to_screen();
+        sink_->keep_unseen(level, std::move(msg));
     }
 
     bool has_unread_logs() const
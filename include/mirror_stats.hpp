@@ -0,0 +1,60 @@
+#pragma once
+
+#include <map>
+#include <cstdint>
+#include <experimental/filesystem>
+
+#include "common.hpp"
+
+namespace fs = std::experimental::filesystem;
+
+namespace bookwyrm {
+
+/*
+ * How each host we have downloaded from has been doing, kept across runs:
+ * exponentially weighted moving averages of its throughput, latency and
+ * failure rate. Used to try the best mirrors first, so that a dead or slow
+ * one doesn't cost us a timeout on every run.
+ *
+ * Not thread-safe; the downloader only uses it from its worker.
+ */
+class mirror_stats {
+public:
+    struct host {
+        double throughput = 0;   /* bytes per second */
+        double latency = 0;      /* seconds until the first byte */
+        double failure_rate = 0; /* in [0, 1] */
+        size_t samples = 0;
+    };
+
+    /* $XDG_CACHE_HOME/bookwyrm/mirrors, or ~/.cache/bookwyrm/mirrors. */
+    static fs::path default_path();
+
+    /* Read the statistics from path, if they are there. */
+    explicit mirror_stats(fs::path path);
+
+    /* Write the statistics back to where they were read from. */
+    void save() const;
+
+    /* A HEAD request either answered after latency seconds, or not at all. */
+    void record_probe(const string &host, bool ok, double latency);
+
+    /* A transfer got bytes in seconds, and either succeeded or not. */
+    void record_transfer(const string &host, bool ok, std::int64_t bytes, double seconds);
+
+    /*
+     * About how many seconds should fetching a reference amount from the host
+     * take, counting the retries its failure rate makes likely? Lower is better.
+     * If given, latency replaces the recorded one with a fresh measurement.
+     */
+    double cost(const string &host, double latency = -1) const;
+
+private:
+    host& sample(const string &host);
+
+    const fs::path path_;
+    std::map<string, host> hosts_;
+};
+
+/* ns bookwyrm */
+}
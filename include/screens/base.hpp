@@ -6,6 +6,7 @@
 #include "colours.hpp"
 #include "keys.hpp"
 #include "runes.hpp"
+#include "utf8.hpp"
 
 namespace screen {
 
@@ -28,8 +29,19 @@ public:
 
     enum move_direction { top, up, down, bot };
 
+    /*
+     * Repaint the rows that have changed since the last paint.
+     * The terminal isn't cleared in between, so a repainted row
+     * must be cleared first (see clear_row()).
+     */
     virtual void paint() = 0;
 
+    /* Forget what's on the terminal: the next paint() redraws every row. */
+    void mark_all_dirty()
+    {
+        all_dirty_ = true;
+    }
+
     /* What should be done when the window resizes? */
     virtual void on_resize() { };
 
@@ -85,30 +97,53 @@ protected:
     /*
      * Akin to Ncurses mvprintw(), but:
      * print a string starting from (x, y) along the x-axis. The space
-     * argument denotes how much of the string is printed. If the string
-     * doesn't fit, the string is truncated with '~'.
+     * argument denotes how many cells the string may take up. If the string
+     * doesn't fit, the string is truncated with '~' (see utf8::fit()).
      *
-     * Returns the count of truncated characters, counter from the end of
-     * the string.
+     * Returns how many cells were printed.
      */
-    int wprintlim(size_t x, const int y, const string_view &str, const size_t space, const colour attrs = colour::white);
-    int wprintlim(size_t x, const int y, const string_view &str, const size_t space, const attribute attr)
+    size_t wprintlim(size_t x, const int y, const string_view &str, const size_t space, const colour attrs = colour::white);
+    size_t wprintlim(size_t x, const int y, const string_view &str, const size_t space, const attribute attr)
     {
         return wprintlim(x, y, str, space, colour::white | attr);
     }
 
-    /* Same as above, but don't truncate. */
-    void wprint(int x, const int y, const string_view &str, const colour attrs = colour::white);
-    void wprint(int x, const int y, const string_view &str, const attribute attr)
+    /*
+     * Same as above, but don't truncate. Strings are UTF-8; wide characters
+     * take up two cells. Returns how many cells were printed.
+     */
+    size_t wprint(int x, const int y, const string_view &str, const colour attrs = colour::white);
+    size_t wprint(int x, const int y, const string_view &str, const attribute attr)
     {
-        wprint(x, y, str, colour::white | attr);
+        return wprint(x, y, str, colour::white | attr);
     }
 
+    /* Print text that's already been laid out. */
+    size_t wprint(int x, const int y, const utf8::text &text, const colour attrs = colour::white);
+
+    /* Row y, or rows [from, to), must be repainted. Rows outside the screen are ignored. */
+    void mark_dirty(int y);
+    void mark_dirty(int from, int to);
+
+    bool is_dirty(int y) const;
+
+    /* Is anything to be repainted at all? */
+    bool has_damage() const;
+
+    /* Blank row y before it is repainted. */
+    void clear_row(int y);
+
+    /* Called at the end of paint(): what's on the terminal is up to date. */
+    void clean();
+
     /* How much space do we leave for bars? */
     int padding_top_, padding_bot_,
         padding_left_, padding_right_;
 
 private:
+    bool all_dirty_ = true;
+    vector<bool> dirty_rows_;
+
     static int screen_count_;
     static void init_tui();
 };
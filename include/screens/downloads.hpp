@@ -0,0 +1,45 @@
+#pragma once
+
+#include <tuple>
+#include <optional>
+
+#include "downloader.hpp"
+#include "screens/base.hpp"
+
+namespace screen {
+
+/*
+ * Lists every item queued for download, one per line, with its
+ * progress, size, transfer rate and whether it is done or failed.
+ * The selected job's priority can be raised or lowered.
+ */
+class downloads : public base {
+public:
+    explicit downloads(bookwyrm::downloader &downloader);
+
+    void paint() override;
+    bool action(const key &key, const uint32_t &ch) override;
+    void move(move_direction dir) override;
+    string footer_info() const override;
+    int scrollpercent() const override;
+
+    string controls_legacy() const override
+    {
+        return "[j/k d/u]Navigation [+/-]Priority";
+    }
+
+private:
+    bookwyrm::downloader &downloader_;
+
+    /* Which job is selected, and how many lines have we scrolled? */
+    size_t selected_, scroll_offset_;
+
+    /* What each row showed when it was last painted: job id, state, priority, progress, selected. */
+    using row_t = std::tuple<size_t, bookwyrm::download_job::status, int, curl_off_t, curl_off_t, bool>;
+    vector<std::optional<row_t>> painted_;
+
+    void print_job(const int y, const bookwyrm::download_job &job, bool selected);
+};
+
+/* ns screen */
+}
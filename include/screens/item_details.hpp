@@ -3,16 +3,16 @@
 #include <fmt/format.h>
 
 #include "item.hpp"
+#include "enricher.hpp"
 #include "screens/base.hpp"
 
 /*
  * Interface-wise, this will be like opening an email for reading in mutt.
- * A thread will be spawned to fetch more info about the item from some database,
- * and the bookwyrm will print that info in this window in a pretty way.
+ * The enricher fetches more info about the item on its own thread, and
+ * the bookwyrm prints that info in this window in a pretty way once it's there.
  *
- * The user should still be able to check another item's details while this thread is running.
- * Item details will be kept in the actual item. So a passed item will be modified, otherwise,
- * if the user goes back to an item, we'll need to fetch the data again.
+ * The user should still be able to check another item's details while a lookup is running.
+ * Looked up details are kept by the enricher, so going back to an item doesn't fetch them again.
  *
  * The user doesn't need to exit the detail screen to select another item for details.
  * Implementing this is a problem for the future, though.
@@ -21,7 +21,7 @@ namespace screen {
 
 class item_details : public base {
 public:
-    explicit item_details(const core::item &item, int padding_top);
+    explicit item_details(const core::item &item, bookwyrm::enricher &enricher, int padding_top);
 
     bool action(const key &key, const uint32_t &ch) override;
     void paint() override;
@@ -41,7 +41,12 @@ public:
     }
 
 private:
-    const core::item &item_;
+    /* A copy; the results it came from may grow (and move) while we're open. */
+    const core::item item_;
+
+    bookwyrm::enricher &enricher_;
+    bookwyrm::enricher::status status_ = bookwyrm::enricher::status::unknown;
+    bookwyrm::item_info info_;
 
     void print_borders();
     void print_details();
@@ -1,18 +1,35 @@
 #pragma once
 
+#include <fstream>
 #include <optional>
+#include <experimental/filesystem>
 
 #include <spdlog/details/log_msg.h>
 
 #include "screens/base.hpp"
 
+namespace fs = std::experimental::filesystem;
+
 namespace screen {
 
+/*
+ * The last so many log entries, newest at the bottom. Older entries are
+ * appended to a spill file instead of being kept in memory; it holds this
+ * run's entries only, and is started anew when the first one is spilled. Each entry is
+ * wrapped once per terminal width, so painting and scrolling only ever
+ * look at the entries on screen.
+ */
 class log : public base {
 public:
-    explicit log();
+    static constexpr size_t default_capacity = 10000;
+
+    /* $XDG_CACHE_HOME/bookwyrm/log, or ~/.cache/bookwyrm/log. */
+    static fs::path default_spill_path();
+
+    explicit log(size_t capacity = default_capacity, fs::path spill = default_spill_path());
 
     void paint() override;
+    void on_resize() override;
     void toggle_action() override;
     void move(move_direction dir) override;
     string footer_info() const override;
@@ -25,20 +42,57 @@ public:
 
     void log_entry(spdlog::level::level_enum level, string msg);
 
+    /* Entries are numbered from the first one ever logged; this is the next one's number. */
+    size_t entry_count() const
+    {
+        return end_;
+    }
+
+    /* Call f(level, msg) for each entry from the nth on that is still in memory, oldest first. */
+    template <typename F>
+    void for_each_since(size_t n, F f) const
+    {
+        for (n = std::max(n, first_); n < end_; n++)
+            f(ring_[n % capacity_].level, ring_[n % capacity_].msg);
+    }
+
 private:
-    using entry_t = std::pair<spdlog::level::level_enum, const string>;
-    vector<entry_t> entries_;
-    using entry_tp = decltype(entries_.cbegin());
+    /* A wrapped line; its first coloured glyphs are printed in the entry level's colour. */
+    struct line_t {
+        utf8::text text;
+        size_t coloured;
+    };
 
-    std::optional<entry_tp> detached_at_;
+    struct entry_t {
+        spdlog::level::level_enum level;
+        string msg;
 
-    void print_entry(int &y, const entry_tp entry);
+        /* msg wrapped for a screen wrapped_width wide. */
+        vector<line_t> lines;
+        size_t wrapped_width = 0;
+    };
 
     /*
-     * Returns the amount of entries in entries_ (starting at the last entry)
-     * that can fit on screen.
+     * A ring of capacity_ entries. Entries are numbered from the first one
+     * ever logged; entry n is in ring_[n % capacity_] if n >= first_.
      */
-    size_t capacity(entry_tp entry) const;
+    vector<entry_t> ring_;
+    const size_t capacity_;
+    size_t first_ = 0, end_ = 0;
+
+    const fs::path spill_path_;
+    std::ofstream spill_;
+
+    /* When detached, the number of the entry after the last one shown. */
+    std::optional<size_t> detached_at_;
+
+    entry_t& entry(size_t n);
+
+    /* The entry's lines, wrapped for the current width. */
+    const vector<line_t>& lines(size_t n);
+
+    /* Write an entry that's about to be dropped from the ring to the spill file. */
+    void spill(const entry_t &e);
 };
 
 /* ns screen */
@@ -1,13 +1,15 @@
 #pragma once
 
-#include <set>
 #include <mutex>
+#include <memory>
 #include <array>
 #include <tuple>
 #include <utility>
 #include <variant>
+#include <functional>
 
 #include "item.hpp"
+#include "bitset.hpp"
 #include "screens/base.hpp"
 
 namespace screen {
@@ -16,6 +18,7 @@ class multiselect_menu : public base {
 public:
     explicit multiselect_menu(vector<core::item> const &items);
 
+    bool action(const key &key, const uint32_t &ch) override;
     void paint() override;
     void on_resize() override;
     void toggle_action() override;
@@ -44,11 +47,61 @@ public:
         return items_.size();
     }
 
-    auto marked_items()
+    /* Indexed by item; an item's index never changes. */
+    const bookwyrm::bitset& marked_items() const
     {
         return marked_items_;
     }
 
+    /*
+     * Bulk marking. Each calls the mark callback for every item whose mark changed,
+     * and is linear in the number of items, so that these stay instant on a huge result set.
+     */
+    void mark_all();
+    void unmark_all();
+    void invert_marks();
+    void mark_if(const std::function<bool(const core::item&)> &pred);
+
+    /* Mark the n items of highest score; ties go to the item found first. */
+    void mark_best(size_t n);
+
+    /* Called with an item's index whenever it is marked (true) or unmarked (false). */
+    void set_mark_callback(std::function<void(size_t, bool)> callback)
+    {
+        mark_callback_ = callback;
+    }
+
+    /*
+     * If set, called once per bulk marking instead, with the indices of the items
+     * it marked and unmarked.
+     */
+    void set_bulk_mark_callback(std::function<void(const vector<size_t>&, const vector<size_t>&)> callback)
+    {
+        bulk_mark_callback_ = callback;
+    }
+
+    /*
+     * Items for which this returns true are already owned, and are shown as such.
+     * It's asked once per item shown, until owned_changed() is called.
+     */
+    void set_owned_predicate(std::function<bool(const core::item&)> owned)
+    {
+        owned_ = owned;
+    }
+
+    /* What we own may have changed; ask the owned predicate again, and repaint. */
+    void owned_changed()
+    {
+        owned_generation_++;
+        mark_all_dirty();
+    }
+
+    /* How well an item matches what the user searched for, from 0 to 100. */
+    void set_score_function(std::function<int(const core::item&)> score)
+    {
+        score_ = score;
+    }
+
 private:
     struct columns_t {
 
@@ -90,11 +143,46 @@ private:
     /* How many lines have we scrolled? */
     size_t scroll_offset_;
 
+    /*
+     * Each item's column strings, formatted and laid out when the item is first painted,
+     * and truncated to the column widths when first painted after a resize. Only what
+     * has been in view is ever formatted, however many items there are.
+     */
+    struct row_t {
+        std::array<utf8::text, 6> text, fitted;
+
+        /* Which layout the fitted strings were truncated for. */
+        size_t layout = 0;
+
+        /* Whether the item is owned, as of owned_generation_ == owned_generation. */
+        bool owned = false;
+        size_t owned_generation = 0;
+    };
+
+    vector<std::unique_ptr<row_t>> rows_;
+
+    /* Bumped whenever the column widths change. */
+    size_t layout_ = 0;
+
+    /* Bumped by owned_changed(). */
+    size_t owned_generation_ = 1;
+
     std::mutex menu_mutex_;
     vector<core::item> const &items_;
 
     /* Item indices marked for download. */
-    std::set<int> marked_items_;
+    bookwyrm::bitset marked_items_;
+
+    /* Each item's score, computed when first needed. */
+    vector<int> scores_;
+
+    /* A count typed before a command, as in vi: "10t" marks the 10 best items. */
+    size_t count_prefix_ = 0;
+
+    std::function<void(size_t, bool)> mark_callback_;
+    std::function<void(const vector<size_t>&, const vector<size_t>&)> bulk_mark_callback_;
+    std::function<bool(const core::item&)> owned_;
+    std::function<int(const core::item&)> score_;
 
     bool is_marked(const size_t idx) const;
 
@@ -116,10 +204,26 @@ private:
     void mark_item(const size_t idx);
     void unmark_item(const size_t idx);
 
+    /*
+     * Apply op to a copy of the marks, then tell the callback about every mark
+     * that changed and repaint what's in view.
+     */
+    void bulk_mark(const std::function<void(bookwyrm::bitset&)> &op);
+
     void update_column_widths();
 
     void print_header();
-    void print_column(const size_t col_idx);
+
+    /* Print the item on row y, all columns that fit. */
+    void print_item(const size_t y);
+
+    static row_t format_row(const core::item &item);
+
+    /* The cached row of item idx, truncated for the current column widths. */
+    const row_t& fitted_row(const size_t idx);
+
+    /* Is item idx owned? Cached in its row. */
+    bool is_owned(const size_t idx);
 };
 
 } /* ns screen */
@@ -1,4 +1,8 @@
+#pragma once
+
+#include <array>
 #include <chrono>
+#include <algorithm>
 
 namespace bookwyrm::time {
 
@@ -27,6 +31,58 @@ private:
     std::chrono::time_point<clock> last_update;
 };
 
+/*
+ * Counts durations in power-of-two buckets of microseconds, from 1us up to about a minute.
+ * Percentiles are thus only accurate to within a factor of two, which is plenty to tell
+ * whether something takes microseconds, milliseconds or seconds.
+ */
+class histogram {
+public:
+    template <typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> d)
+    {
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+
+        size_t bucket = 0;
+        while (bucket < buckets_.size() - 1 && (1ll << bucket) < us)
+            bucket++;
+
+        buckets_[bucket]++;
+        count_++;
+        max_ms_ = std::max(max_ms_, us / 1000.0);
+    }
+
+    size_t count() const
+    {
+        return count_;
+    }
+
+    /* The upper bound of the bucket the p:th percentile (0-100) falls in, in milliseconds. */
+    double percentile(double p) const
+    {
+        const double wanted = count_ * p / 100;
+
+        size_t seen = 0;
+        for (size_t bucket = 0; bucket < buckets_.size(); bucket++) {
+            seen += buckets_[bucket];
+            if (seen > 0 && seen >= wanted)
+                return std::min((1ll << bucket) / 1000.0, max_ms_);
+        }
+
+        return max_ms_;
+    }
+
+    double max() const
+    {
+        return max_ms_;
+    }
+
+private:
+    std::array<size_t, 27> buckets_{};
+    size_t count_ = 0;
+    double max_ms_ = 0;
+};
+
 /*
  * A time duration based on seconds, with an interface alike Boost's posix time library.
  * Takes a duration of seconds and divides that up in hours, minutes and seconds.
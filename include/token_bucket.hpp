@@ -0,0 +1,44 @@
+#pragma once
+
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+namespace bookwyrm {
+
+/*
+ * Limits the combined rate of all transfers sharing the bucket.
+ *
+ * Each transfer takes tokens (bytes) before passing on what it received.
+ * The bucket refills at the given rate, holding at most a second's worth,
+ * so that an idle period doesn't allow a large burst afterwards.
+ */
+class token_bucket {
+    using clock = std::chrono::steady_clock;
+
+public:
+    /* A rate of 0 bytes/s means unlimited. */
+    explicit token_bucket(std::int64_t rate = 0);
+
+    void set_rate(std::int64_t rate);
+    std::int64_t rate() const;
+
+    /*
+     * Take n tokens. If the bucket runs dry, the debt is recorded and the
+     * calling thread sleeps until it would have been paid off, which in
+     * turn lets TCP slow the sender down.
+     */
+    void consume(std::int64_t n);
+
+private:
+    /* Add the tokens accumulated since the last refill. mutex_ must be held. */
+    void refill();
+
+    mutable std::mutex mutex_;
+    std::int64_t rate_;
+    double tokens_;
+    clock::time_point last_refill_;
+};
+
+/* ns bookwyrm */
+}
@@ -1,15 +1,21 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 
 #include "core/plugin_handler.hpp"
 #include "core/item.hpp"
 #include "common.hpp"
 #include "colours.hpp"
 #include "logger.hpp"
+#include "downloader.hpp"
+#include "enricher.hpp"
+#include "time.hpp"
 #include "screens/base.hpp"
 #include "screens/multiselect_menu.hpp"
 #include "screens/item_details.hpp"
 #include "screens/log.hpp"
+#include "screens/downloads.hpp"
 
 /* Circular dependency guard. */
 namespace logger { class bookwyrm_logger; }
@@ -19,39 +25,48 @@ namespace core { class plugin_handler; }
 
 namespace bookwyrm {
 
+/*
+ * Only the thread running display() calls into termbox or touches the screens.
+ * Other threads (plugins, the downloader, the logger) only ask it for a repaint
+ * with update(); log entries are moved from the logger's sink to the log screen,
+ * and new results are copied over from the plugin handler, before the repaint.
+ * Repaints asked for are held to one per frame.
+ */
 class tui : public core::frontend {
 public:
     void update()
     {
-        repaint_screens();
+        pending_update_ = true;
     }
 
     void log(const core::log_level level, const string message);
 
-    /* Send a log entry to the log screen. */
-    void log(const spdlog::level::level_enum level, const string message)
+    /* Send a log entry to the log screen. Only from the thread running display(). */
+    void log(const spdlog::level::level_enum level, string message)
     {
-        log_->log_entry(level, message);
-        repaint_screens();
+        log_->log_entry(level, std::move(message));
     }
 
     /* WARN: this constructor should only be used in make_with() above. */
-    explicit tui(vector<core::item> &items, logger_t logger);
+    /* results_from(n) returns a copy of the results found after the first n; see plugin_handler. */
+    explicit tui(std::function<vector<core::item>(size_t)> results_from, const core::item &wanted,
+            logger_t logger, downloader &downloader, size_t log_lines);
 
-    /* Repaint all screens that need updating. */
+    /* Hands the log entries never looked at back to the logger, which prints them. */
+    ~tui();
+
+    /* Repaint all screens that need updating. Only from the thread running display(). */
     void repaint_screens();
 
     /*
      * Display the TUI and let the user enter input.
      * The input is forwarded to the appropriate screen.
+     * Marked items are downloaded in the background while the user browses.
      * Returns false if user wants the program to exit without downloading anything.
      * Returns true otherwise.
      */
     bool display();
 
-    /* Take ownership of the wanted items and move them to the caller. */
-    vector<core::item> get_wanted_items();
-
     /* Draw the context sensitive footer. */
     void print_footer();
 
@@ -61,24 +76,58 @@ public:
     }
 
 private:
-    /* Forwarded to the multiselect menu. */
-    vector<core::item> const &items_;
+    /*
+     * The results found so far, forwarded to the multiselect menu. The plugins add to
+     * the plugin handler's, under its lock; we copy what's new over on our own thread.
+     */
+    std::function<vector<core::item>(size_t)> results_from_;
+    vector<core::item> items_;
 
     /* Used to flush stored logs to the log screen. */
     logger_t logger_;
 
+    /* The number of the first log entry not yet seen on the log screen. */
+    size_t log_read_ = 0;
+
+    /* Items are queued here as soon as they are marked. */
+    downloader &downloader_;
+
     std::shared_ptr<screen::multiselect_menu> index_;
     std::shared_ptr<screen::item_details> details_;
     std::shared_ptr<screen::log> log_;
+    std::shared_ptr<screen::downloads> downloads_;
 
     std::shared_ptr<screen::base> focused_, last_;
 
+    /* Has another thread asked for a repaint? */
+    std::atomic<bool> pending_update_{false};
+
+    /* Keypress to present, and how long each repaint takes. */
+    time::histogram input_latency_, frame_time_;
+
+    /* Repaints that aren't caused by input are held to one per this many ms. */
+    static constexpr int frame_budget_ms = 16;
+
     /* Is a screen::item_details open? */
     bool viewing_details_;
 
     /* When we close the screen::item_details, how much does the index menu scroll back? */
     int index_scrollback_ = -1;
 
+    /* Clear the terminal and repaint every row on the next repaint? */
+    bool full_repaint_ = true;
+
+    /* What was on screen after the last repaint, and what we owned then. */
+    std::shared_ptr<screen::base> painted_focus_;
+    bool painted_fits_ = false;
+    size_t library_generation_ = 0;
+
+    /*
+     * Looks up details of the item under the cursor ahead of time, so that they're
+     * there when it's opened. Last, so that its thread is gone before the rest of us.
+     */
+    enricher enricher_;
+
     /* Returns false if bookwyrm doesn't fit in the terminal window. */
     static bool bookwyrm_fits();
 
@@ -96,10 +145,23 @@ private:
 
     bool toggle_log();
 
+    /* Everything on the log screen has been seen. */
+    void mark_log_read();
+    bool toggle_downloads();
+
     void resize_screens();
 
-    /* copy from screen::base. */
-    static void wprint(int x, const int y, const string_view &str, const colour attrs = colour::white);
+    /*
+     * Move new log entries to the log screen, marking them read if it's in view,
+     * and copy over new results. Returns true if a repaint is due.
+     */
+    bool drain_messages();
+
+    /* Log the latency histograms. */
+    void report_latency();
+
+    /* copy from screen::base. Returns the column after the string. */
+    static int wprint(int x, const int y, const string_view &str, const colour attrs = colour::white);
 
     /*
      * Print passed string starting from (x, y) along the x-axis.
@@ -113,7 +175,9 @@ private:
     }
 };
 
-std::shared_ptr<tui> make_tui_with(core::plugin_handler &plugin_handler, logger_t &logger);
+/* The log screen keeps log_lines entries; older ones are spilled to screen::log::default_spill_path(). */
+std::shared_ptr<tui> make_tui_with(core::plugin_handler &plugin_handler, logger_t &logger,
+        downloader &downloader, size_t log_lines = screen::log::default_capacity);
 
 /* ns bookwyrm */
 }
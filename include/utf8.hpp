@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+#include "common.hpp"
+#include "runes.hpp"
+
+/*
+ * Text layout for the terminal: UTF-8 decoding and display widths.
+ *
+ * A string is laid out once into glyphs, one per user-perceived character,
+ * each with the number of cells it occupies. Combining marks, variation
+ * selectors and the like are folded into the glyph they belong to, so that
+ * a string is never cut between a character and its accents. Termbox only
+ * draws one code point per cell; those are drawn, the folded ones are not.
+ */
+namespace utf8 {
+
+struct glyph {
+    rune_t rune;
+
+    /* 1, or 2 for East Asian wide and fullwidth characters. */
+    uint8_t width;
+};
+
+struct text {
+    vector<glyph> glyphs;
+
+    /* The sum of the glyphs' widths. */
+    size_t width = 0;
+
+    bool empty() const { return glyphs.empty(); }
+};
+
+/*
+ * Decode the code point starting at str[pos] and advance pos past it.
+ * Malformed or truncated sequences decode to U+FFFD, one byte at a time.
+ */
+rune_t decode(const string_view &str, size_t &pos);
+
+/*
+ * How many cells the code point takes up: 0 for combining and other
+ * zero-width characters, 2 for East Asian wide and fullwidth ones, 1 otherwise.
+ */
+int width(rune_t rune);
+
+/* Lay out str. Control characters are dropped. */
+text layout(const string_view &str);
+
+/* The display width of str; the same as layout(str).width, without the allocations. */
+size_t width(const string_view &str);
+
+/*
+ * Truncate t to at most the given number of cells. If it doesn't fit, print
+ * as much as we can (save its trailing whitespace) followed by a '~'.
+ * A wide glyph is never split in half.
+ */
+text fit(const text &t, size_t cells);
+
+/* Split t after at most the given number of cells. */
+std::pair<text, text> split(const text &t, size_t cells);
+
+/* ns utf8 */
+}
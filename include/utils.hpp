@@ -1,6 +1,7 @@
 #pragma once
 
 #include <unistd.h>
+#include <cstdint>
 #include <algorithm>
 #include <system_error>
 #include <experimental/filesystem>
@@ -16,8 +17,8 @@ namespace fs = std::experimental::filesystem;
 
 namespace utils {
 
-/* Check if the path is a valid download directory. */
-std::error_code validate_download_dir(const fs::path &path);
+/* Check if the path is a valid download directory, with at least needed bytes free. */
+std::error_code validate_download_dir(const fs::path &path, uintmax_t needed = 1);
 
 string vector_to_string(const vector<string> &vec);
 vector<string> split_string(const string &str);
@@ -26,6 +27,9 @@ std::pair<string, string> split_at_first(const string &str, string &&sep);
 /* Check if the given path is a file and can be read. */
 bool readable_file(const fs::path &path);
 
+/* Where we keep what's worth remembering between runs: $XDG_CACHE_HOME/bookwyrm or ~/.cache/bookwyrm. */
+fs::path cache_dir();
+
 /*
  * Return a rounded percentage in the range [0,100]
  * from a domain of [0.0,1.0]
@@ -43,5 +47,11 @@ string lipsum(int repeats);
 
 const core::item create_item(const cliparser &cli);
 
+/*
+ * Parse a transfer rate in bytes per second, e.g. 500, 200k or 1.5M.
+ * Throws value_error if it isn't one.
+ */
+std::int64_t parse_rate(const string &rate);
+
 /* ns utils */
 }
@@ -0,0 +1,247 @@
+#include <iostream>
+#include <algorithm>
+
+#include "batch.hpp"
+
+namespace bookwyrm {
+
+namespace {
+
+const char* state_name(download_job::status state)
+{
+    using status = download_job::status;
+
+    switch (state) {
+        case status::queued:      return "queued";
+        case status::downloading: return "downloading";
+        case status::done:        return "done";
+        case status::failed:      return "failed";
+        case status::cancelled:   return "cancelled";
+    }
+
+    return "unknown";
+}
+
+const char* level_name(core::log_level level)
+{
+    using lvl = core::log_level;
+
+    switch (level) {
+        case lvl::trace:    return "trace";
+        case lvl::debug:    return "debug";
+        case lvl::info:     return "info";
+        case lvl::warn:     return "warning";
+        case lvl::err:      return "error";
+        case lvl::critical: return "critical";
+        case lvl::off:      break;
+    }
+
+    return "off";
+}
+
+bool finished(download_job::status state)
+{
+    return state != download_job::status::queued && state != download_job::status::downloading;
+}
+
+/* ns anonymous */
+}
+
+batch::batch(core::plugin_handler &plugin_handler, downloader &downloader,
+        size_t best, int min_score, core::log_level min_level)
+    : plugin_handler_(plugin_handler), downloader_(downloader),
+    best_(best), min_score_(min_score), min_level_(min_level)
+{
+
+}
+
+void batch::update()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        updated_ = true;
+    }
+
+    cv_.notify_one();
+}
+
+void batch::log(const core::log_level level, const string message)
+{
+    if (level < min_level_)
+        return;
+
+    json::object event;
+    event["event"] = {string("log")};
+    event["level"] = {string(level_name(level))};
+    event["message"] = {message};
+    emit(std::move(event));
+}
+
+bool batch::run()
+{
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait_for(lock, progress_interval, [this] { return updated_; });
+            updated_ = false;
+        }
+
+        /* Asked first: once no plugin is searching, every result is already in. */
+        const bool searching = plugin_handler_.searching();
+
+        for (const auto &item : plugin_handler_.results_from(seen_))
+            consider(seen_++, item);
+
+        if (report_jobs() && !searching)
+            break;
+    }
+
+    size_t downloaded = 0, owned = 0;
+    const auto jobs = downloader_.jobs();
+    for (const auto &c : chosen_) {
+        if (c.owned) {
+            owned++;
+            continue;
+        }
+
+        const auto job = std::find_if(jobs.cbegin(), jobs.cend(), [&c](const auto &j) { return j->id == c.id; });
+        if (job != jobs.cend() && (*job)->state == download_job::status::done)
+            downloaded++;
+    }
+
+    json::object event;
+    event["event"] = {string("finished")};
+    event["found"] = {static_cast<double>(seen_)};
+    event["chosen"] = {static_cast<double>(chosen_.size())};
+    event["downloaded"] = {static_cast<double>(downloaded)};
+    event["owned"] = {static_cast<double>(owned)};
+    emit(std::move(event));
+
+    return !chosen_.empty() && downloaded + owned == chosen_.size();
+}
+
+void batch::consider(size_t id, const core::item &item)
+{
+    const int score = item.score(plugin_handler_.wanted());
+    if (score < min_score_ || best_ == 0)
+        return;
+
+    if (chosen_.size() >= best_) {
+        const auto jobs = downloader_.jobs();
+        const auto queued = [&jobs](const choice &c) {
+            if (c.owned) return false;
+
+            const auto job = std::find_if(jobs.cbegin(), jobs.cend(), [&c](const auto &j) { return j->id == c.id; });
+            return job != jobs.cend() && (*job)->state == download_job::status::queued;
+        };
+
+        auto worst = chosen_.end();
+        for (auto c = chosen_.begin(); c != chosen_.end(); ++c) {
+            if (queued(*c) && (worst == chosen_.end() || c->score < worst->score))
+                worst = c;
+        }
+
+        if (worst == chosen_.end() || worst->score >= score)
+            return;
+
+        downloader_.cancel(worst->id);
+        reported_.erase(worst->id);
+
+        json::object event;
+        event["event"] = {string("dropped")};
+        event["id"] = {static_cast<double>(worst->id)};
+        event["replaced_by"] = {static_cast<double>(id)};
+        emit(std::move(event));
+
+        chosen_.erase(worst);
+    }
+
+    const bool owned = downloader_.local_library().owns(item);
+    chosen_.push_back({id, score, owned});
+
+    json::array authors;
+    for (const auto &a : item.nonexacts.authors)
+        authors.push_back({a});
+
+    json::object event;
+    event["event"] = {string(owned ? "owned" : "queued")};
+    event["id"] = {static_cast<double>(id)};
+    event["score"] = {static_cast<double>(score)};
+    event["title"] = {item.nonexacts.title};
+    event["authors"] = {std::move(authors)};
+    event["extension"] = {item.exacts.extension};
+    emit(std::move(event));
+
+    if (!owned)
+        downloader_.async_download(id, item);
+}
+
+bool batch::report_jobs()
+{
+    const auto now = std::chrono::steady_clock::now();
+    const auto jobs = downloader_.jobs();
+    bool all_finished = true;
+
+    for (const auto &c : chosen_) {
+        if (c.owned)
+            continue;
+
+        const auto job = std::find_if(jobs.cbegin(), jobs.cend(), [&c](const auto &j) { return j->id == c.id; });
+        if (job == jobs.cend()) {
+            all_finished = false;
+            continue;
+        }
+
+        const download_job &j = **job;
+        const download_job::status state = j.state;
+        all_finished &= finished(state);
+
+        const auto last = reported_.find(c.id);
+        const bool changed = last == reported_.cend() || last->second.state != state;
+
+        json::object event;
+        event["id"] = {static_cast<double>(c.id)};
+
+        if (changed && state != download_job::status::queued) {
+            event["event"] = {string(state_name(state))};
+            if (state == download_job::status::done) {
+                event["md5"] = {j.md5};
+                event["sha256"] = {j.sha256};
+            }
+        } else if (state == download_job::status::downloading && now - last->second.at >= progress_interval) {
+            event["event"] = {string("progress")};
+            event["dlnow"] = {static_cast<double>(j.dlnow)};
+            event["dltotal"] = {static_cast<double>(j.dltotal)};
+            event["rate"] = {j.rate.load()};
+        } else {
+            continue;
+        }
+
+        reported_[c.id] = {state, now};
+        emit(std::move(event));
+    }
+
+    return all_finished;
+}
+
+void batch::emit(json::object event)
+{
+    const string line = json::dump({std::move(event)});
+
+    std::lock_guard<std::mutex> guard(output_mutex_);
+    std::cout << line << std::endl;
+}
+
+std::shared_ptr<batch> make_batch_with(core::plugin_handler &plugin_handler, downloader &downloader,
+        size_t best, int min_score, core::log_level min_level)
+{
+    plugin_handler.load_plugins();
+    auto b = std::make_shared<batch>(plugin_handler, downloader, best, min_score, min_level);
+    plugin_handler.set_frontend(b);
+    downloader.set_frontend(b);
+    plugin_handler.async_search();
+    return b;
+}
+
+/* ns bookwyrm */
+}
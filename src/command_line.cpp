@@ -25,7 +25,8 @@ enum {
     main,
     excl,
     exact,
-    misc
+    misc,
+    batch
 };
 
 enum { /* magic padding numbers */
@@ -182,6 +183,9 @@ void cliparser::validate_arguments() const
 
     if (has(1))
         throw argument_error("only one positional argument (the download path) is allowed");
+
+    if ((has("best") || has("min-score")) && !has("batch"))
+        throw argument_error("--best and --min-score only apply with --batch");
 }
 
 bool cliparser::parse_pair(const string_view &input, const string_view &input_next)
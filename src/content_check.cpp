@@ -0,0 +1,110 @@
+#include <map>
+#include <cctype>
+#include <algorithm>
+
+#include <fmt/format.h>
+
+#include "content_check.hpp"
+
+namespace bookwyrm {
+
+namespace {
+
+/* Where in the file to look, and what we expect to find there. */
+struct magic {
+    size_t offset;
+    string bytes;
+};
+
+const std::map<string, magic> magic_numbers = {
+    {"pdf",  {0,  "%PDF-"}},
+    {"ps",   {0,  "%!PS"}},
+    {"djvu", {0,  "AT&TFORM"}},
+    {"djv",  {0,  "AT&TFORM"}},
+    {"epub", {0,  string("PK\x03\x04", 4)}},
+    {"cbz",  {0,  string("PK\x03\x04", 4)}},
+    {"zip",  {0,  string("PK\x03\x04", 4)}},
+    {"docx", {0,  string("PK\x03\x04", 4)}},
+    {"odt",  {0,  string("PK\x03\x04", 4)}},
+    {"rar",  {0,  "Rar!"}},
+    {"cbr",  {0,  "Rar!"}},
+    {"chm",  {0,  "ITSF"}},
+    {"rtf",  {0,  "{\\rtf"}},
+    {"doc",  {0,  "\xd0\xcf\x11\xe0"}},
+    {"mobi", {60, "BOOKMOBI"}},
+    {"azw",  {60, "BOOKMOBI"}},
+    {"azw3", {60, "BOOKMOBI"}},
+    {"prc",  {60, "BOOKMOBI"}},
+};
+
+string lowercase(string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+    return str;
+}
+
+/* ns anonymous */
+}
+
+content_check::content_check(string extension, bool at_start)
+    : extension_(lowercase(std::move(extension))), at_start_(at_start)
+{
+}
+
+content_check::verdict content_check::feed(const char *data, size_t len, const char *content_type)
+{
+    if (verdict_ != verdict::pending)
+        return verdict_;
+
+    head_.append(data, len);
+
+    /* The headers are all in by the time the body arrives. */
+    if (!type_checked_) {
+        type_checked_ = true;
+
+        const string type = content_type ? lowercase(content_type) : "";
+        const bool wants_html = extension_ == "html" || extension_ == "htm";
+
+        if (type.compare(0, 9, "text/html") == 0 && !wants_html) {
+            reason_ = fmt::format("got a {} page instead of a .{} file", type, extension_);
+            return verdict_ = verdict::implausible;
+        }
+    }
+
+    return verdict_ = judge(false);
+}
+
+content_check::verdict content_check::finish()
+{
+    if (verdict_ == verdict::pending)
+        verdict_ = judge(true);
+
+    return verdict_;
+}
+
+content_check::verdict content_check::judge(bool final)
+{
+    const auto magic = magic_numbers.find(extension_);
+
+    /* Nothing more to go on. */
+    if (!at_start_ || magic == magic_numbers.cend())
+        return verdict::plausible;
+
+    const auto &[offset, bytes] = magic->second;
+    if (head_.size() < offset + bytes.size()) {
+        if (!final) return verdict::pending;
+
+        reason_ = fmt::format("the data is too short to be a .{} file", extension_);
+        return verdict::implausible;
+    }
+
+    if (head_.compare(offset, bytes.size(), bytes) != 0) {
+        reason_ = fmt::format("the data doesn't look like a .{} file", extension_);
+        return verdict::implausible;
+    }
+
+    return verdict::plausible;
+}
+
+/* ns bookwyrm */
+}
@@ -1,9 +1,26 @@
+#include <optional>
+
 #include <fmt/format.h>
 
 #include "python.hpp"
 #include "utils.hpp"
 #include "item.hpp"
 #include "plugin_handler.hpp"
+#include "trace.hpp"
+
+namespace {
+
+/* What bw.span() gives a plugin: a trace span for the duration of a with block. */
+struct plugin_span {
+    plugin_span(const string &name, const string &detail)
+        : name(name), detail(detail) {}
+
+    string name, detail;
+    std::optional<core::trace::span> span;
+};
+
+/* ns anonymous */
+}
 
 PYBIND11_MODULE(pybookwyrm, m)
 {
@@ -95,7 +112,36 @@ PYBIND11_MODULE(pybookwyrm, m)
         .value("warn",  core::log_level::warn)
         .value("error", core::log_level::err);
 
+    py::register_exception<core::http_error>(m, "http_error", PyExc_ConnectionError);
+
     py::class_<core::plugin_handler>(m, "bookwyrm")
         .def("feed",        &core::plugin_handler::add_item)
-        .def("log",         &core::plugin_handler::log);
+        .def("log",         &core::plugin_handler::log)
+        .def("get",         [](core::plugin_handler &h, const string &url) {
+            /* Let the other plugins run while we wait for the network. */
+            string body;
+            {
+                std::optional<py::gil_scoped_release> nogil(std::in_place);
+                {
+                    core::trace::span get("http", "get", url);
+                    body = h.http_get(url);
+                }
+
+                core::trace::span reacquire("python", "acquire GIL");
+                nogil.reset();
+            }
+
+            return py::bytes(body);
+        });
+
+    /*
+     * For plugins to show where their time goes in --trace, e.g.:
+     *
+     *   with bw.span("parse results", url):
+     *       ...
+     */
+    py::class_<plugin_span>(m, "span")
+        .def(py::init<const string&, const string&>(), "name"_a, "detail"_a = "")
+        .def("__enter__", [](plugin_span &s) { s.span.emplace("plugin", s.name, s.detail); })
+        .def("__exit__",  [](plugin_span &s, py::args) { s.span.reset(); });
 }
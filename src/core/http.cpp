@@ -0,0 +1,96 @@
+#include <fmt/format.h>
+
+#include "http.hpp"
+
+namespace core {
+
+http_share::http_share()
+{
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    share_ = curl_share_init();
+    if (!share_) throw std::runtime_error("curl could not initialize a share handle");
+
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, http_share::lock);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, http_share::unlock);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+http_share::~http_share()
+{
+    curl_share_cleanup(share_);
+    curl_global_cleanup();
+}
+
+void http_share::lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+    (void)handle;
+    (void)access;
+
+    static_cast<http_share*>(userptr)->locks_[data].lock();
+}
+
+void http_share::unlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+    (void)handle;
+
+    static_cast<http_share*>(userptr)->locks_[data].unlock();
+}
+
+void http_share::attach(CURL *handle)
+{
+    curl_easy_setopt(handle, CURLOPT_SHARE, share_);
+}
+
+void http_share::record(CURL *handle)
+{
+    long connects = 0;
+    if (curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects) != CURLE_OK)
+        connects = 0;
+
+    transfers_++;
+    connections_ += connects;
+}
+
+static size_t append_body(char *data, size_t size, size_t nmemb, void *userdata)
+{
+    static_cast<std::string*>(userdata)->append(data, size * nmemb);
+    return size * nmemb;
+}
+
+std::string http_get(const std::string &url, http_share *share)
+{
+    CURL *handle = curl_easy_init();
+    if (!handle) throw http_error("curl could not initialize");
+
+    std::string body;
+    curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1);
+    curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, 30);
+    curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, append_body);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, &body);
+
+    if (share) share->attach(handle);
+
+    const CURLcode res = curl_easy_perform(handle);
+    if (share) share->record(handle);
+
+    long status = 0;
+    if (res == CURLE_HTTP_RETURNED_ERROR)
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_cleanup(handle);
+
+    if (res != CURLE_OK)
+        throw http_error(fmt::format("{}: {}", url, curl_easy_strerror(res)), status);
+
+    return body;
+}
+
+/* ns core */
+}
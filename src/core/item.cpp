@@ -23,6 +23,31 @@ const string nonexacts_t::get_value(const std::map<string, string> &dict, const
     return elem == dict.cend() ? "" : elem->second;
 }
 
+/* The fuzzily matched strings of an item, but for the authors. */
+static std::array<string, 3> fuzzy_fields(const item &i)
+{
+    return {{ i.nonexacts.title, i.nonexacts.series, i.nonexacts.publisher }};
+}
+
+/* The best ratio of any wanted author to any of the item's, or the first one that's good_enough. */
+static int author_ratio(const item &wanted, const item &result, int good_enough)
+{
+    int max_ratio = 0;
+    for (const auto& [req, got] : algorithm::product(wanted.nonexacts.authors, result.nonexacts.authors)) {
+        /*
+         * From some quick testing, it feels like token_set_ratio
+         * works best here.
+         */
+        const int ratio = fuzz::token_set_ratio(req, got);
+        max_ratio = std::max(ratio, max_ratio);
+
+        if (max_ratio >= good_enough)
+            break;
+    }
+
+    return max_ratio;
+}
+
 bool item::matches(const item &wanted) const
 {
     // TODO: implement operator== for exacts_t?
@@ -44,18 +69,7 @@ bool item::matches(const item &wanted) const
             !utils::any_intersection(wanted.misc.isbns, this->misc.isbns))
         return false;
 
-    const std::array<string, 3> in_result = {{
-                                    this->nonexacts.title,
-                                    this->nonexacts.series,
-                                    this->nonexacts.publisher
-                                }},
-                                requested = {{
-                                    wanted.nonexacts.title,
-                                    wanted.nonexacts.series,
-                                    wanted.nonexacts.publisher
-                                }};
-
-    for (const auto& [req, got] : func::zip(requested, in_result)) {
+    for (const auto& [req, got] : func::zip(fuzzy_fields(wanted), fuzzy_fields(*this))) {
         if (!req.empty()) {
             /*
              * partial: useful for course literature that can have some
@@ -67,26 +81,29 @@ bool item::matches(const item &wanted) const
         }
     }
 
-    if (!wanted.nonexacts.authors.empty()) {
-        int max_ratio = 0;
-        for (const auto& [req, got] : algorithm::product(wanted.nonexacts.authors,
-                    this->nonexacts.authors)) {
-            /*
-             * From some quick testing, it feels like token_set_ratio
-             * works best here.
-             */
-            int ratio = fuzz::token_set_ratio(req, got);
-            max_ratio = std::max(ratio, max_ratio);
+    if (!wanted.nonexacts.authors.empty() && author_ratio(wanted, *this, fuzzy_min) < fuzzy_min)
+        return false;
+
+    return true;
+}
+
+int item::score(const item &wanted) const
+{
+    int total = 0, fields = 0;
 
-            if (max_ratio >= fuzzy_min)
-                break;
+    for (const auto& [req, got] : func::zip(fuzzy_fields(wanted), fuzzy_fields(*this))) {
+        if (!req.empty()) {
+            total += fuzz::partial_ratio(got, req);
+            fields++;
         }
+    }
 
-        if (max_ratio < fuzzy_min)
-            return false;
+    if (!wanted.nonexacts.authors.empty()) {
+        total += author_ratio(wanted, *this, 100);
+        fields++;
     }
 
-    return true;
+    return fields > 0 ? total / fields : 100;
 }
 
 /* ns bookwyrm */
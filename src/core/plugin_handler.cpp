@@ -2,6 +2,8 @@
 #include <cerrno>
 #include <cstdlib>
 #include <array>
+#include <cctype>
+#include <optional>
 #include <experimental/filesystem>
 
 #include <fmt/format.h>
@@ -9,11 +11,14 @@
 #include "utils.hpp"
 #include "python.hpp"
 #include "plugin_handler.hpp"
+#include "trace.hpp"
 
 namespace fs = std::experimental::filesystem;
 
 namespace core {
 
+thread_local string plugin_handler::plugin_name_;
+
 void plugin_handler::load_plugins()
 {
     vector<fs::path> plugin_paths;
@@ -85,17 +90,35 @@ plugin_handler::~plugin_handler()
 
 void plugin_handler::async_search()
 {
+    searching_ = plugins_.size();
+
     for (const auto &m : plugins_) {
         threads_.emplace_back([&m, wanted = wanted_, instance = this]() {
             /* Required whenever we need to run anything Python. */
-            py::gil_scoped_acquire gil;
+            std::optional<py::gil_scoped_acquire> gil;
+            {
+                trace::span acquire("python", "acquire GIL");
+                gil.emplace();
+            }
+
+            /* Whatever is logged on this thread is the plugin's. */
+            plugin_name_ = m.attr("__name__").cast<string>();
+            trace::name_thread(plugin_name_);
 
             try {
+                trace::span search("plugin", plugin_name_);
                 m.attr("find")(wanted, instance);
             } catch (const py::error_already_set &err) {
                 instance->log(log_level::err, fmt::format("module '{}' did something wrong: {}; ignoring...",
                     m.attr("__name__").cast<string>(), err.what()));
             }
+
+            /* Nothing more will come from it to report these for us. */
+            instance->flush_log();
+
+            instance->searching_--;
+            if (!instance->frontend_.expired())
+                instance->frontend_.lock()->update();
         });
     }
 
@@ -108,9 +131,17 @@ void plugin_handler::async_search()
 
 void plugin_handler::add_item(std::tuple<nonexacts_t, exacts_t, misc_t> item_comps)
 {
+    trace::span feed("plugin", "feed");
+
     const item item(item_comps);
-    if (!item.matches(wanted_) || item.misc.uris.size() == 0)
-        return;
+    {
+        trace::span match("match", "match");
+        const bool matched = item.matches(wanted_);
+        match.set_detail(!matched ? "rejected" : item.misc.uris.empty() ? "no uris" : "matched");
+
+        if (!matched || item.misc.uris.size() == 0)
+            return;
+    }
 
     std::lock_guard<std::mutex> guard(items_mutex_);
 
@@ -120,10 +151,119 @@ void plugin_handler::add_item(std::tuple<nonexacts_t, exacts_t, misc_t> item_com
         frontend_.lock()->update();
 }
 
+/* The message with every run of digits replaced by a '#'. */
+static string shape_of(const string &msg)
+{
+    string shape;
+    shape.reserve(msg.length());
+
+    for (auto ch = msg.cbegin(); ch != msg.cend(); ++ch) {
+        if (!std::isdigit(static_cast<unsigned char>(*ch))) {
+            shape += *ch;
+        } else if (shape.empty() || shape.back() != '#') {
+            shape += '#';
+        }
+    }
+
+    return shape;
+}
+
+static string folded_message(const string &last, size_t repeats)
+{
+    return fmt::format("{} (repeated {}×)", last, repeats);
+}
+
+static string dropped_message(const string &source, size_t dropped)
+{
+    return fmt::format("{}: dropped {} log entries over its budget", source.empty() ? "bookwyrm" : source, dropped);
+}
+
 void plugin_handler::log(log_level lvl, string msg)
 {
-    if (!frontend_.expired())
-        frontend_.lock()->log(lvl, msg);
+    using clock = std::chrono::steady_clock;
+
+    /* What to send to the frontend, once we've let go of the lock. */
+    vector<std::pair<log_level, string>> out;
+    const auto folded = [](const log_source &src) {
+        return std::make_pair(src.level, folded_message(src.last, src.repeats));
+    };
+
+    {
+        std::lock_guard<std::mutex> guard(log_mutex_);
+        auto &src = log_sources_[plugin_name_];
+        const auto now = clock::now();
+
+        src.budget = std::min(log_burst,
+                src.budget + std::chrono::duration<double>(now - src.refilled).count() * log_rate);
+        src.refilled = now;
+
+        if (string shape = shape_of(msg); lvl == src.level && shape == src.shape) {
+            /* Same as last time; only count it. */
+            src.last = std::move(msg);
+            src.repeats++;
+
+            if (now - src.folded_since >= fold_interval) {
+                out.push_back(folded(src));
+                src.repeats = 0;
+                src.folded_since = now;
+            }
+        } else {
+            if (src.repeats > 0)
+                out.push_back(folded(src));
+
+            src.last = msg;
+            src.shape = std::move(shape);
+            src.level = lvl;
+            src.repeats = 0;
+            src.folded_since = now;
+
+            if (src.budget >= 1) {
+                src.budget--;
+
+                if (src.dropped > 0) {
+                    out.emplace_back(log_level::warn, dropped_message(plugin_name_, src.dropped));
+                    src.dropped = 0;
+                }
+
+                out.emplace_back(lvl, std::move(msg));
+            } else {
+                src.dropped++;
+            }
+        }
+    }
+
+    if (const auto fe = frontend_.lock()) {
+        for (auto &[level, entry] : out)
+            fe->log(level, std::move(entry));
+    }
+}
+
+void plugin_handler::flush_log()
+{
+    vector<std::pair<log_level, string>> out;
+
+    {
+        std::lock_guard<std::mutex> guard(log_mutex_);
+        const auto it = log_sources_.find(plugin_name_);
+        if (it == log_sources_.end())
+            return;
+
+        auto &src = it->second;
+        if (src.repeats > 0) {
+            out.emplace_back(src.level, folded_message(src.last, src.repeats));
+            src.repeats = 0;
+        }
+
+        if (src.dropped > 0) {
+            out.emplace_back(log_level::warn, dropped_message(plugin_name_, src.dropped));
+            src.dropped = 0;
+        }
+    }
+
+    if (const auto fe = frontend_.lock()) {
+        for (auto &[level, entry] : out)
+            fe->log(level, std::move(entry));
+    }
 }
 
 /* ns butler */
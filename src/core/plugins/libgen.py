@@ -87,6 +87,18 @@ class LibgenSeeker(object):
         else:
             print(msg)
 
+    def get(self, url):
+        """
+        Fetch a page. Through bookwyrm, DNS lookups, TLS sessions and connections
+        are shared with the downloader; standalone, we make do with requests.
+        """
+        if self.bookwyrm:
+            return self.bookwyrm.get(url).decode('utf-8', 'replace')
+
+        r = requests.get(url)
+        r.raise_for_status()
+        return r.text
+
     def feed(self, item):
         if self.bookwyrm:
             self.bookwyrm.feed(item)
@@ -109,7 +121,7 @@ class LibgenSeeker(object):
                             self.process_ffiction(table)
                         else:
                             self.log(Loglevel.warn, 'unknown path "%s"; ignored.' % path)
-                except requests.exceptions.ConnectionError as e:
+                except (requests.exceptions.ConnectionError, bw.http_error) as e:
                     self.log(Loglevel.error, 'connection error (%s)! Trying another domain/query...' % e)
                     continue
                 except requests.exceptions.HTTPError as e:
@@ -256,13 +268,8 @@ class LibgenSeeker(object):
         while True:
             f.set({'page': p}).add(query_params)
 
-            r = requests.get(f.url)
-            if r.status_code != requests.codes.ok:
-                # TODO: Log failure to bookwyrm?
-                # Or log after taking exception?
-                r.raise_for_status()
-
-            soup = BeautifulSoup(r.text, 'html.parser')
+            text = self.get(f.url)
+            soup = BeautifulSoup(text, 'html.parser')
             try:
                 table = extract_table[str(f.path)](soup)
             except KeyError:
@@ -270,7 +277,7 @@ class LibgenSeeker(object):
                 raise NotImplementedError("only parsing for LibGen and ffiction currently supported.")
 
             # Have we gone through all pages?
-            if f.path == '/search.php' and r.text == last_request:
+            if f.path == '/search.php' and text == last_request:
                 return
             elif f.path == '/foreignfiction/index.php' and table.text == '':
                 return
@@ -278,7 +285,7 @@ class LibgenSeeker(object):
             yield table
 
             p += 1
-            last_request = r.text
+            last_request = text
 
     def process_libgen(self, table):
         """
@@ -373,8 +380,7 @@ class LibgenSeeker(object):
                 # Final URL contains same md5-hash, but an additional key parameter is
                 # required (16 chars, alphanumeric, uppercase). Seems to be generated on
                 # the fly. Or can it be solved for somehow?
-                r = requests.get(libgenio)
-                soup = BeautifulSoup(r.text, 'html.parser')
+                soup = BeautifulSoup(self.get(libgenio), 'html.parser')
                 # -2 here, but -1 on foreignfiction
                 final = soup.table.find_all('td')[-2].a['href']
                 urls.append(final)
@@ -384,8 +390,7 @@ class LibgenSeeker(object):
                 # Final URL contains another hash, which is always the same: the two hashes are
                 # related. Now, is this a hash of the book itself, or the md5? (hash-finder hints
                 # at CRC-96).
-                r = requests.get(libgenpw)
-                soup = BeautifulSoup(r.text, 'html.parser')
+                soup = BeautifulSoup(self.get(libgenpw), 'html.parser')
 
                 # We can skip a third request by getting the libgen.pw's hash and
                 # craft the final URL.
@@ -458,8 +463,7 @@ class LibgenSeeker(object):
                 # Final URL contains same md5-hash, but an additional key parameter is
                 # required (16 chars, alphanumeric, uppercase). Seems to be generated on
                 # the fly. Or can it be solved for somehow?
-                r = requests.get(io)
-                soup = BeautifulSoup(r.text, 'html.parser')
+                soup = BeautifulSoup(self.get(io), 'html.parser')
                 final = soup.table.find_all('td')[-1].a['href']
                 urls.append(final)
 
@@ -468,8 +472,7 @@ class LibgenSeeker(object):
                 # Final URL contains another hash, which is always the same: the two hashes are
                 # related. Now, is this a hash of the book itself, or the md5? (hash-finder hints
                 # at CRC-96).
-                r = requests.get(pw)
-                soup = BeautifulSoup(r.text, 'html.parser')
+                soup = BeautifulSoup(self.get(pw), 'html.parser')
 
                 # We can skip a third request by getting the libgen.pw's hash and
                 # craft the final URL.
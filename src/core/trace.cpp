@@ -0,0 +1,193 @@
+#include <array>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#include <fmt/format.h>
+
+#include "trace.hpp"
+
+namespace core::trace {
+
+namespace {
+
+/* How many events each thread keeps; older ones are overwritten. */
+constexpr size_t ring_capacity = 16384;
+
+/* Kept in place, so that recording one is a copy and never an allocation. */
+struct event {
+    const char *category;
+    std::array<char, detail::name_size> name;
+    std::array<char, detail::detail_size> detail;
+    clock::time_point begin;
+    clock::duration duration;
+};
+
+/* A thread's events, which outlive the thread so that its spans are still written. */
+struct thread_buffer {
+    std::mutex mutex;
+    std::vector<event> ring;
+    size_t recorded = 0;
+    size_t tid;
+    std::string name;
+};
+
+std::mutex registry_mutex;
+std::vector<std::shared_ptr<thread_buffer>> registry;
+clock::time_point epoch;
+
+thread_buffer& this_thread()
+{
+    thread_local std::shared_ptr<thread_buffer> buffer = [] {
+        auto b = std::make_shared<thread_buffer>();
+        b->ring.resize(ring_capacity);
+
+        std::lock_guard<std::mutex> guard(registry_mutex);
+        b->tid = registry.size() + 1;
+        b->name = fmt::format("thread {}", b->tid);
+        registry.push_back(b);
+        return b;
+    }();
+
+    return *buffer;
+}
+
+std::string escaped(std::string_view s)
+{
+    std::string out;
+    out.reserve(s.size());
+
+    for (const char c : s) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                    out += fmt::format("\\u{:04x}", static_cast<int>(c));
+                else
+                    out += c;
+        }
+    }
+
+    return out;
+}
+
+/* Microseconds since start(), as Chrome traces want them. */
+double micros(clock::duration d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+/* ns anonymous */
+}
+
+namespace detail {
+
+std::atomic<bool> recording{false};
+
+void record(const char *category, std::string_view name, std::string_view detail,
+        clock::time_point begin, clock::time_point end)
+{
+    thread_buffer &b = this_thread();
+    std::lock_guard<std::mutex> guard(b.mutex);
+
+    event &e = b.ring[b.recorded++ % ring_capacity];
+    e.category = category;
+    copy_into(e.name, name);
+    copy_into(e.detail, detail);
+    e.begin = begin;
+    e.duration = end - begin;
+}
+
+/* ns detail */
+}
+
+void start()
+{
+    epoch = clock::now();
+    detail::recording = true;
+}
+
+void name_thread(const std::string &name)
+{
+    if (!enabled())
+        return;
+
+    thread_buffer &b = this_thread();
+    std::lock_guard<std::mutex> guard(b.mutex);
+    b.name = name;
+}
+
+void write_chrome_trace(std::ostream &os)
+{
+    std::vector<std::shared_ptr<thread_buffer>> buffers;
+    {
+        std::lock_guard<std::mutex> guard(registry_mutex);
+        buffers = registry;
+    }
+
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    const auto separate = [&os, &first] {
+        if (!first) os << ",\n";
+        first = false;
+    };
+
+    for (const auto &b : buffers) {
+        std::lock_guard<std::mutex> guard(b->mutex);
+
+        separate();
+        os << fmt::format(R"({{"ph":"M","name":"thread_name","pid":1,"tid":{},"args":{{"name":"{}"}}}})",
+                b->tid, escaped(b->name));
+
+        /* Oldest first; if the ring has wrapped, that's the one after the newest. */
+        const size_t count = std::min(b->recorded, ring_capacity);
+        for (size_t i = b->recorded - count; i < b->recorded; i++) {
+            const event &e = b->ring[i % ring_capacity];
+            const bool instant = e.duration == clock::duration::zero();
+
+            separate();
+            os << fmt::format(R"({{"ph":"{}","cat":"{}","name":"{}","pid":1,"tid":{},"ts":{:.3f})",
+                    instant ? "i" : "X", e.category, escaped(e.name.data()), b->tid, micros(e.begin - epoch));
+
+            if (instant)
+                os << R"(,"s":"t")";
+            else
+                os << fmt::format(R"(,"dur":{:.3f})", micros(e.duration));
+
+            if (e.detail[0] != '\0')
+                os << fmt::format(R"(,"args":{{"detail":"{}"}})", escaped(e.detail.data()));
+
+            os << '}';
+        }
+    }
+
+    os << "],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+session::session(const std::string &path)
+    : path_(path)
+{
+    start();
+}
+
+session::~session()
+{
+    detail::recording = false;
+
+    std::ofstream file(path_);
+    write_chrome_trace(file);
+    file.close();
+
+    /* We're on our way out; all that's left is to say so. */
+    if (!file)
+        fmt::print(stderr, "error: couldn't write the trace to '{}'\n", path_);
+}
+
+/* ns core::trace */
+}
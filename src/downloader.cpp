@@ -3,35 +3,34 @@
 #include <cerrno>
 #include <cstring>
 #include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
 #include <iomanip>
 #include <sstream>
+#include <numeric>
+#include <algorithm>
 
 #include <fmt/ostream.h>
 
+#include "core/trace.hpp"
 #include "downloader.hpp"
 #include "runes.hpp"
 #include "utils.hpp"
 
 namespace bookwyrm {
 
-downloader::downloader(string download_dir)
-    : pbar(true, true), dldir(download_dir)
+/* Items smaller than two segments are fetched in a single stream. */
+static constexpr curl_off_t min_segment_size = 4 * 1024 * 1024;
+static constexpr size_t max_segments = 8;
+
+downloader::downloader(string download_dir, std::shared_ptr<core::http_share> share)
+    : pbar(true, true), dldir(download_dir), share_(share), library_(dldir), stats_(mirror_stats::default_path())
 {
     curl_global_init(CURL_GLOBAL_ALL);
-    curl = curl_easy_init();
+    curl = make_handle();
     if (!curl) throw component_error("curl could not initialize");
 
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT,
-           "Mozilla/5.0 (X11; Linux x86_64; rv:57.0) Gecko/20100101 Firefox/57.0");
-
-    /* Complete the connection phase within 30s. */
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30);
-
-    /* Consider HTTP codes >=400 as errors. This option is NOT fail-safe. */
-    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1);
-
     /* Set callback function for writing data. */
     /* curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, downloader::write_data); */
 
@@ -40,36 +39,711 @@ downloader::downloader(string download_dir)
     curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
     curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0);
 
-    /*
-     * Assume there is a connection error and abort transfer with CURLE_OPERATION_TIMEDOUT
-     * if the download speed is under 30B/s for 60s.
-     */
-    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 30);
-    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60);
-
     /* Enable a verbose output. */
     /* curl_easy_setopt(curl, CURLOPT_VERBOSE, 1); */
-    /* curl_easy_setopt(curl,CURLOPT_MAX_RECV_SPEED_LARGE, 1024 * 50); */
+
+    /*
+     * The rate is limited by bucket_ rather than CURLOPT_MAX_RECV_SPEED_LARGE,
+     * which only applies to a single handle, not to all segments together.
+     */
 
     /* std::cout << rune::vt100::hide_cursor; */
+
+    worker_ = std::thread(&downloader::work, this);
 }
 
 downloader::~downloader()
 {
+    cancel_all();
+
+    {
+        std::lock_guard<std::mutex> guard(jobs_mutex_);
+        stop_ = true;
+    }
+
+    jobs_cv_.notify_all();
+    worker_.join();
+
     curl_easy_cleanup(curl);
     curl_global_cleanup();
 
     /* std::cout << rune::vt100::show_cursor; */
 }
 
+CURL* downloader::make_handle()
+{
+    CURL *handle = curl_easy_init();
+    if (!handle) return nullptr;
+
+    if (share_) share_->attach(handle);
+
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1);
+    curl_easy_setopt(handle, CURLOPT_USERAGENT,
+           "Mozilla/5.0 (X11; Linux x86_64; rv:57.0) Gecko/20100101 Firefox/57.0");
+
+    /* Complete the connection phase within 30s. */
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, 30);
+
+    /* Consider HTTP codes >=400 as errors. This option is NOT fail-safe; see content_check. */
+    curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1);
+
+    /*
+     * Assume there is a connection error and abort transfer with CURLE_OPERATION_TIMEDOUT
+     * if the download speed is under 30B/s for 60s.
+     */
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, 30);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, 60);
+
+    return handle;
+}
+
+size_t downloader::header_callback(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+    auto *info = static_cast<remote_info*>(userdata);
+    const size_t len = size * nitems;
+    string header(buffer, len);
+    std::transform(header.begin(), header.end(), header.begin(), ::tolower);
+
+    /* A new response (e.g. after a redirect); forget what the last one said. */
+    if (header.compare(0, 5, "http/") == 0) {
+        info->accepts_ranges = false;
+        info->etag.clear();
+    } else if (header.compare(0, 14, "accept-ranges:") == 0) {
+        info->accepts_ranges = header.find("bytes") != string::npos;
+    } else if (header.compare(0, 5, "etag:") == 0) {
+        /* The tag itself is case sensitive, so take it from the original buffer. */
+        string etag(buffer + 5, len - 5);
+        const auto first = etag.find_first_not_of(" \t\r\n"),
+                   last  = etag.find_last_not_of(" \t\r\n");
+        info->etag = first == string::npos ? "" : etag.substr(first, last - first + 1);
+    }
+
+    return len;
+}
+
+vector<remote_info> downloader::probe(const vector<string> &urls)
+{
+    vector<remote_info> infos(urls.size());
+    CURLM *multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(max_host_connections_));
+
+    for (size_t i = 0; i < urls.size(); i++) {
+        CURL *handle = make_handle();
+        if (!handle) continue;
+
+        curl_easy_setopt(handle, CURLOPT_URL, urls[i].c_str());
+        curl_easy_setopt(handle, CURLOPT_NOBODY, 1);
+        curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, downloader::header_callback);
+        curl_easy_setopt(handle, CURLOPT_HEADERDATA, &infos[i]);
+        curl_easy_setopt(handle, CURLOPT_PRIVATE, &infos[i]);
+
+        /* A mirror that takes this long to answer a HEAD is of no use to us anyway. */
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT, 30);
+
+        curl_multi_add_handle(multi, handle);
+    }
+
+    int running = 0;
+    do {
+        curl_multi_perform(multi, &running);
+
+        int queued;
+        while (CURLMsg *msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            CURL *handle = msg->easy_handle;
+            remote_info *info;
+            curl_easy_getinfo(handle, CURLINFO_PRIVATE, &info);
+            record(handle);
+
+            if (msg->data.result == CURLE_OK) {
+                info->reachable = true;
+
+                curl_off_t length;
+                if (curl_easy_getinfo(handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) == CURLE_OK)
+                    info->length = length;
+
+                double ttfb;
+                if (curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &ttfb) == CURLE_OK)
+                    info->ttfb = ttfb;
+            } else {
+                *info = remote_info();
+            }
+
+            stats_.record_probe(host_of(urls[info - infos.data()]), info->reachable, info->ttfb);
+
+            curl_multi_remove_handle(multi, handle);
+            curl_easy_cleanup(handle);
+        }
+
+        if (running > 0)
+            curl_multi_wait(multi, nullptr, 0, 100, nullptr);
+    } while (running > 0);
+
+    curl_multi_cleanup(multi);
+    return infos;
+}
+
+void downloader::probe_jobs(const vector<std::shared_ptr<download_job>> &jobs)
+{
+    vector<string> urls;
+    for (const auto &job : jobs)
+        urls.insert(urls.end(), job->item.misc.uris.cbegin(), job->item.misc.uris.cend());
+
+    const auto infos = probe(urls);
+
+    auto info = infos.cbegin();
+    for (const auto &job : jobs) {
+        job->mirrors.assign(info, info + job->item.misc.uris.size());
+        info += job->item.misc.uris.size();
+        job->probed = true;
+        job->probed_at = std::chrono::steady_clock::now();
+
+        /* Until the download starts, show the size the mirrors agree on (well, the first one). */
+        for (const auto &mirror : job->mirrors) {
+            if (mirror.length > 0 && job->dltotal == 0) {
+                job->dltotal = mirror.length;
+                break;
+            }
+        }
+    }
+
+    /* Will everything that is queued fit? */
+    uintmax_t needed = 0;
+    {
+        std::lock_guard<std::mutex> guard(jobs_mutex_);
+        for (const auto &job : jobs_) {
+            if (job->state == download_job::status::queued)
+                needed += job->dltotal;
+        }
+    }
+
+    if (needed > 0 && utils::validate_download_dir(dldir, needed) == std::errc::no_space_on_device) {
+        log(core::log_level::warn, fmt::format("the queued items need {:.1f}MB, but {} hasn't that much space left",
+                static_cast<double>(needed) / 1024 / 1024, dldir.string()));
+    }
+}
+
+size_t downloader::segment_write_callback(char *data, size_t size, size_t nmemb, void *userdata)
+{
+    auto *seg = static_cast<segment*>(userdata);
+    const size_t len = size * nmemb;
+
+    /*
+     * A mirror that ignores our Range header answers with a 200 and the
+     * whole file, which would overwrite the other segments. Returning
+     * anything but len aborts the transfer.
+     */
+    if (!seg->validated) {
+        long code = 0;
+        curl_easy_getinfo(seg->handle, CURLINFO_RESPONSE_CODE, &code);
+        if (code != 206) return 0;
+        seg->validated = true;
+    }
+
+    if (seg->offset + static_cast<curl_off_t>(seg->check.head().size() + len) > seg->end + 1)
+        return 0;
+
+    seg->bucket->consume(len);
+    return deliver(seg->handle, seg->check, *seg->writer, seg->offset, data, len) ? len : 0;
+}
+
+size_t downloader::stream_write_callback(char *data, size_t size, size_t nmemb, void *userdata)
+{
+    auto *s = static_cast<stream*>(userdata);
+    const size_t len = size * nmemb;
+
+    s->bucket->consume(len);
+    if (!deliver(s->handle, s->check, *s->writer, s->offset, data, len))
+        return 0;
+
+    /* Should we be interrupted, we lose at most a second of progress. */
+    if (s->since_journal.ms_since_last_update() >= 1000) {
+        s->since_journal.reset();
+        s->jrnl->offset = s->writer->written_until(0);
+        s->jrnl->write(s->jpath);
+    }
+
+    return len;
+}
+
+bool downloader::deliver(CURL *handle, content_check &check, file_writer &writer,
+        curl_off_t &offset, const char *data, size_t len)
+{
+    using verdict = content_check::verdict;
+
+    if (check.result() == verdict::plausible) {
+        if (!writer.write(data, len, offset))
+            return false;
+
+        offset += len;
+        return true;
+    }
+
+    char *content_type = nullptr;
+    curl_easy_getinfo(handle, CURLINFO_CONTENT_TYPE, &content_type);
+
+    switch (check.feed(data, len, content_type)) {
+        case verdict::pending:
+            /* Held back until we know more. */
+            return true;
+        case verdict::implausible:
+            return false;
+        case verdict::plausible:
+            break;
+    }
+
+    /* The check holds everything we got so far, this chunk included. */
+    return flush(check, writer, offset);
+}
+
+bool downloader::flush(content_check &check, file_writer &writer, curl_off_t &offset)
+{
+    if (check.finish() != content_check::verdict::plausible)
+        return false;
+
+    string &head = check.head();
+    if (head.empty()) return true;
+
+    if (!writer.write(head.data(), head.size(), offset))
+        return false;
+
+    offset += head.size();
+    head.clear();
+    return true;
+}
+
+bool downloader::verify(hash::digest &digest, const string &expected_md5)
+{
+    const string md5 = digest.md5.hexdigest(),
+                 sha256 = digest.sha256.hexdigest();
+
+    if (!expected_md5.empty() && md5 != expected_md5) {
+        log(core::log_level::warn, fmt::format("checksum mismatch: expected MD5 {}, got {}",
+                    expected_md5, md5));
+        return false;
+    }
+
+    if (current_) {
+        current_->md5 = md5;
+        current_->sha256 = sha256;
+    }
+
+    return true;
+}
+
+downloader::segmented_result downloader::segmented_download(const vector<string> &uris,
+        const vector<remote_info> &infos, const fs::path &filename,
+        const std::optional<journal> &resume, const string &md5)
+{
+    /* Find the mirrors that can serve byte ranges of the same file. */
+    vector<string> mirrors;
+    string etag;
+    curl_off_t length = -1;
+    for (size_t i = 0; i < uris.size(); i++) {
+        const auto &info = infos[i];
+        if (!info.accepts_ranges || info.length <= 0)
+            continue;
+
+        if (length == -1) {
+            length = info.length;
+            etag = info.etag;
+        } else if (length != info.length) {
+            continue;  /* Not the same file, apparently. */
+        }
+
+        mirrors.push_back(uris[i]);
+    }
+
+    if (mirrors.empty() || length < 2 * min_segment_size)
+        return segmented_result::fall_back;
+
+    const fs::path part = part_path(filename),
+                   jpath = journal_path(filename);
+    const string extension = filename.extension().string().substr(filename.has_extension() ? 1 : 0);
+
+    /*
+     * We can pick up where we left off if the journal describes a file of the same
+     * length, and the mirror it was started from (if still here) hasn't changed it.
+     */
+    const bool resuming = [&]() {
+        if (!resume || resume->ranges.empty() || resume->length != length)
+            return false;
+
+        if (std::error_code ec; fs::file_size(part, ec) != static_cast<uintmax_t>(length))
+            return false;
+
+        const auto url = std::find(uris.cbegin(), uris.cend(), resume->url);
+        if (url == uris.cend()) return true;
+
+        const auto &info = infos[url - uris.cbegin()];
+        return resume->etag.empty() || info.etag.empty() || resume->etag == info.etag;
+    }();
+
+    /* Opened for reading too, so that we can hash segments that arrive out of order. */
+    const int fd = open(part.c_str(), O_RDWR | O_CREAT | (resuming ? 0 : O_TRUNC), 0644);
+    if (fd < 0) {
+        throw component_error(fmt::format("unable to create this file: {}; reason: {}",
+                    part.string(), std::strerror(errno)));
+    }
+
+    /* Reserve the space up front so that the segments don't fragment the file. */
+    if (!resuming && !file_writer::preallocate(fd, length)) {
+        close(fd);
+        fs::remove(part);
+        throw component_error(fmt::format("unable to allocate {} bytes for {}; reason: {}",
+                    length, part.string(), std::strerror(errno)));
+    }
+
+    vector<journal::range> ranges;
+    if (resuming) {
+        ranges = resume->ranges;
+    } else {
+        /* More segments than we may open connections would only wait in line. */
+        size_t count = std::min<size_t>(max_segments, length / min_segment_size);
+        if (const size_t per_host = max_host_connections_; per_host > 0)
+            count = std::min(count, per_host * mirrors.size());
+
+        const curl_off_t chunk = length / count;
+
+        for (size_t i = 0; i < count; i++) {
+            const curl_off_t start = i * chunk,
+                             end = (i == count - 1) ? length - 1 : (i + 1) * chunk - 1;
+            ranges.push_back({start, start, end});
+        }
+    }
+
+    const size_t count = ranges.size();
+    vector<segment> segments(count);
+    CURLM *multi = curl_multi_init();
+
+    /* Transfers beyond the limit are queued by curl until a connection frees up. */
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(max_host_connections_));
+
+    /* What we got during an earlier attempt is only read back to be hashed. */
+    vector<file_writer::range> existing;
+    for (const auto &r : ranges)
+        existing.emplace_back(r.start, r.offset);
+
+    hash::digest digest;
+    file_writer writer(fd, digest, existing);
+
+    journal jrnl;
+    jrnl.url = mirrors.front();
+    jrnl.etag = etag;
+    jrnl.length = length;
+
+    /*
+     * Record how far each segment has come. Only count what has reached the
+     * disk; what is still buffered would be lost if we were interrupted.
+     */
+    const auto write_journal = [&]() {
+        jrnl.ranges.clear();
+        for (const auto &seg : segments)
+            jrnl.ranges.push_back({seg.start, std::min(writer.written_until(seg.start), seg.offset), seg.end});
+
+        jrnl.write(jpath);
+    };
+
+    /* (Re)start the transfer of the remaining range from the segment's mirror. */
+    const auto start_transfer = [&](segment &seg) {
+        seg.validated = false;
+        seg.check = content_check(extension, seg.offset == 0);
+        seg.from = seg.offset;
+
+        /* curl copies the strings, so these may go out of scope. */
+        const string range = fmt::format("{}-{}", seg.offset, seg.end);
+        curl_easy_setopt(seg.handle, CURLOPT_URL, mirrors[seg.mirror].c_str());
+        curl_easy_setopt(seg.handle, CURLOPT_RANGE, range.c_str());
+        curl_multi_add_handle(multi, seg.handle);
+    };
+
+    for (size_t i = 0; i < count; i++) {
+        auto &seg = segments[i];
+        seg.writer = &writer;
+        seg.bucket = &bucket_;
+        seg.start = ranges[i].start;
+        seg.offset = ranges[i].offset;
+        seg.end = ranges[i].end;
+        seg.mirror = i % mirrors.size();
+
+        seg.handle = make_handle();
+        curl_easy_setopt(seg.handle, CURLOPT_WRITEFUNCTION, downloader::segment_write_callback);
+        curl_easy_setopt(seg.handle, CURLOPT_WRITEDATA, &seg);
+        curl_easy_setopt(seg.handle, CURLOPT_PRIVATE, &seg);
+
+        if (!ranges[i].done())
+            start_transfer(seg);
+    }
+
+    write_journal();
+
+    /*
+     * Drive all transfers from this thread. A segment that fails is resumed
+     * from where it stopped on the next mirror, until every mirror has failed it.
+     */
+    vector<size_t> failures(count, 0);
+    bool failed = false;
+    int running = 0;
+    time::timer elapsed, since_journal;
+
+    const auto downloaded = [&segments]() {
+        curl_off_t bytes = 0;
+        for (const auto &seg : segments)
+            bytes += seg.offset - seg.start;
+        return bytes;
+    };
+
+    /* Don't count what we got during an earlier attempt towards the rate. */
+    const curl_off_t resumed = downloaded();
+
+    do {
+        curl_multi_perform(multi, &running);
+
+        int queued;
+        while (CURLMsg *msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            segment *seg;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &seg);
+            curl_multi_remove_handle(multi, seg->handle);
+            record(seg->handle);
+
+            /* A range too short for the check to decide is judged by what we got. */
+            const bool done = msg->data.result == CURLE_OK && flush(seg->check, writer, seg->offset) &&
+                    seg->offset == seg->end + 1;
+
+            double seconds = 0;
+            curl_easy_getinfo(seg->handle, CURLINFO_TOTAL_TIME, &seconds);
+            stats_.record_transfer(host_of(mirrors[seg->mirror]), done, seg->offset - seg->from, seconds);
+
+            if (done) continue;
+
+            if (seg->check.result() == content_check::verdict::implausible) {
+                log(core::log_level::warn, fmt::format("{}: {}; trying another mirror",
+                        host_of(mirrors[seg->mirror]), seg->check.reason()));
+            }
+
+            const size_t idx = seg - segments.data();
+            if (++failures[idx] >= mirrors.size()) {
+                failed = true;
+                break;
+            }
+
+            seg->mirror = (seg->mirror + 1) % mirrors.size();
+            start_transfer(*seg);
+            running++;
+        }
+
+        if (failed || (failed = cancelled()))
+            break;
+
+        const curl_off_t dlnow = downloaded();
+        const double rate = (dlnow - resumed) / std::max(elapsed.ms_since_last_update() / 1000, 0.001);
+        report_progress(length, dlnow, rate, running == 0);
+
+        /* Should we be interrupted, we lose at most a second of progress. */
+        if (since_journal.ms_since_last_update() >= 1000) {
+            since_journal.reset();
+            write_journal();
+        }
+
+        if (running > 0)
+            curl_multi_wait(multi, nullptr, 0, 100, nullptr);
+    } while (running > 0);
+
+    for (auto &seg : segments) {
+        curl_multi_remove_handle(multi, seg.handle);
+        curl_easy_cleanup(seg.handle);
+    }
+    curl_multi_cleanup(multi);
+
+    /* Flush what is still buffered; the writer has hashed the file once it is all on disk. */
+    failed = !writer.finish() || failed || writer.hashed() != length;
+    close(fd);
+
+    if (failed) {
+        write_journal();
+
+        /*
+         * Keep the .part file and its journal around; the next attempt can resume from them.
+         * A single stream would start the file over, so we only try one if we got nothing.
+         */
+        const bool kept = std::any_of(jrnl.ranges.cbegin(), jrnl.ranges.cend(),
+                [](const journal::range &r) { return r.offset > r.start; });
+
+        if (cancelled())
+            return segmented_result::partial;
+
+        if (kept) {
+            log(core::log_level::err, "segmented download failed; what we got is kept for the next attempt");
+            return segmented_result::partial;
+        }
+
+        fs::remove(part);
+        fs::remove(jpath);
+        log(core::log_level::err, "segmented download failed; falling back to a single stream");
+        return segmented_result::fall_back;
+    }
+
+    /*
+     * We can't tell which mirror sent us the bad data, so start over with
+     * a single stream; it verifies each mirror on its own.
+     */
+    if (!verify(digest, md5)) {
+        fs::remove(part);
+        fs::remove(jpath);
+        return segmented_result::fall_back;
+    }
+
+    return segmented_result::done;
+}
+
+bool downloader::single_download(const vector<string> &uris, const vector<remote_info> &infos,
+        const fs::path &filename, const std::optional<journal> &resume, const string &md5)
+{
+    const fs::path part = part_path(filename),
+                   jpath = journal_path(filename);
+    const string extension = filename.extension().string().substr(filename.has_extension() ? 1 : 0);
+
+    int mirror = 1;
+    for (size_t i = 0; i < uris.size() && !cancelled(); i++) {
+        const auto &url = uris[i];
+        const auto &info = infos[i];
+
+        /* Resuming, if we may; then, if the mirror won't let us, once more from the start. */
+        for (bool may_resume = true; !cancelled(); may_resume = false) {
+            /*
+             * Continue the .part file if it was written by a single stream from this
+             * very mirror, and the mirror still serves the same file.
+             */
+            curl_off_t offset = 0;
+            if (may_resume && resume && resume->ranges.empty() && resume->url == url &&
+                    (resume->etag.empty() || resume->etag == info.etag)) {
+                std::error_code ec;
+                const auto size = fs::file_size(part, ec);
+                offset = ec ? 0 : std::min<curl_off_t>(resume->offset, size);
+            }
+
+            const int fd = open(part.c_str(), O_RDWR | O_CREAT | (offset > 0 ? 0 : O_TRUNC), 0644);
+            if (fd < 0) {
+                throw component_error(fmt::format("unable to create this file: {}; reason: {}",
+                            part.string(), std::strerror(errno)));
+            }
+
+            /* If the mirror told us the length, reserve the space; it is trimmed once we're done. */
+            if (info.length > 0 && offset == 0)
+                file_writer::preallocate(fd, info.length);
+
+            /* What we got earlier must be hashed too; it is read back just this once. */
+            hash::digest digest;
+            vector<file_writer::range> existing;
+            if (offset > 0) existing.emplace_back(0, offset);
+            file_writer writer(fd, digest, existing);
+
+            journal jrnl;
+            jrnl.url = url;
+            jrnl.etag = info.etag;
+            jrnl.length = info.length;
+            jrnl.offset = offset;
+            jrnl.write(jpath);
+
+            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, offset);
+            resumed_from_ = offset;
+
+            stream s;
+            s.handle = curl;
+            s.check = content_check(extension, offset == 0);
+            s.writer = &writer;
+            s.bucket = &bucket_;
+            s.offset = offset;
+            s.jrnl = &jrnl;
+            s.jpath = jpath;
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, downloader::stream_write_callback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &s);
+
+            /*
+             * A failed write or content check aborts the transfer with CURLE_WRITE_ERROR.
+             * Here, only what was held back or is still buffered can fail.
+             */
+            CURLcode res = curl_easy_perform(curl);
+            record(curl);
+            if (res == CURLE_OK && !flush(s.check, writer, s.offset))
+                res = CURLE_WRITE_ERROR;
+            if (!writer.finish() && res == CURLE_OK)
+                res = CURLE_WRITE_ERROR;
+
+            /* Neither the user giving up nor our resuming is the mirror's fault. */
+            if (!cancelled() && !(res == CURLE_RANGE_ERROR && offset > 0)) {
+                double seconds = 0;
+                curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &seconds);
+                stats_.record_transfer(host_of(url), res == CURLE_OK, s.offset - offset, seconds);
+            }
+
+            if (res != CURLE_OK) {
+                close(fd);
+
+                /* The mirror won't let us resume; try it again from the start. */
+                if (res == CURLE_RANGE_ERROR && offset > 0)
+                    continue;
+
+                if (s.check.result() == content_check::verdict::implausible) {
+                    log(core::log_level::warn, fmt::format("item download (mirror {}): {}; trying the next one",
+                            mirror++, s.check.reason()));
+                } else if (!cancelled()) {
+                    log(core::log_level::err, fmt::format("item download (mirror {}) failed: {} (CURLcode = {})",
+                            mirror++, curl_easy_strerror(res), res));
+                }
+
+                /* Remember how far we got, so that the next attempt can resume from there. */
+                if (const auto until = writer.written_until(0); until == 0) {
+                    fs::remove(part);
+                    fs::remove(jpath);
+                } else {
+                    jrnl.offset = until;
+                    jrnl.write(jpath);
+                }
+
+            } else {
+                /* The file may have been preallocated for more than we got. */
+                const bool truncated = ftruncate(fd, s.offset) == 0;
+                close(fd);
+
+                if (!truncated || writer.hashed() != s.offset || !verify(digest, md5)) {
+                    /* The mirror sent us something else; don't resume from it. */
+                    fs::remove(part);
+                    fs::remove(jpath);
+                    mirror++;
+                    break;
+                }
+
+                /* That source worked, so there is no need to download from the others. */
+                return true;
+            }
+
+            break;
+        }
+    }
+
+    return false;
+}
+
 fs::path downloader::generate_filename(const core::item &item)
 {
     const fs::path base = dldir / fmt::format("{} - {} ({})",
             utils::vector_to_string(item.nonexacts.authors),
             item.nonexacts.title, item.exacts.year);
 
-    const auto valid_candidate = [](fs::path p) {
-        return !fs::exists(p);
+    /*
+     * The final file only appears once its download completes, so a free
+     * candidate with a .part file next to it is an earlier, unfinished
+     * download of (presumably) this item, which will then be resumed.
+     *
+     * The library lists the directory, so we needn't ask the disk for every candidate.
+     */
+    const auto valid_candidate = [this](fs::path p) {
+        return !library_.taken(p.filename().string());
     };
 
     /* If filename.ext doesn't exists, we use that. */
@@ -99,51 +773,410 @@ fs::path downloader::generate_filename(const core::item &item)
     return candidate;
 }
 
-bool downloader::sync_download(vector<core::item> items)
+bool downloader::download(download_job &job)
 {
-    bool any_success = false;
+    const auto &item = job.item;
 
-    for (const auto &item : items) {
-        auto filename = generate_filename(item);
-        bool success = false;
+    /* Pick up whatever appeared in the directory since we last looked. */
+    library_.refresh();
 
-        int mirror = 1;
-        for (const auto &url : item.misc.uris) {
-            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    if (const auto owned = library_.find(item); owned) {
+        log(core::log_level::info, fmt::format("already have {}; not downloading it again", owned->filename));
+        return true;
+    }
 
-            std::FILE *out = std::fopen(filename.c_str(), "wb");
-            if (out == NULL) {
-                /* TODO: test this output */
-                throw component_error(fmt::format("unable to create this file: {}; reason: {}",
-                            filename.string(), std::strerror(errno)));
+    const auto filename = generate_filename(item);
+    const size_t transfers = share_ ? share_->transfers() : 0,
+                 connections = share_ ? share_->connections() : 0;
+    const auto resume = journal::read(journal_path(filename));
+
+    /* The job may have waited in the queue for a while since we last asked. */
+    if (!job.probed || std::chrono::steady_clock::now() - job.probed_at > std::chrono::minutes(1)) {
+        job.mirrors = probe(item.misc.uris);
+        job.probed = true;
+        job.probed_at = std::chrono::steady_clock::now();
+    }
+
+    /*
+     * Try the mirrors that answered first; among those, the ones that have
+     * served us best, judged by their history and how quickly they answered now.
+     */
+    vector<double> costs;
+    for (size_t i = 0; i < item.misc.uris.size(); i++)
+        costs.push_back(stats_.cost(host_of(item.misc.uris[i]), job.mirrors[i].ttfb));
+
+    vector<size_t> order(item.misc.uris.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&job, &costs](size_t a, size_t b) {
+        const auto &x = job.mirrors[a], &y = job.mirrors[b];
+        if (x.reachable != y.reachable)
+            return x.reachable;
+
+        return costs[a] < costs[b];
+    });
+
+    vector<string> uris;
+    vector<remote_info> infos;
+    curl_off_t length = -1;
+    for (size_t i : order) {
+        uris.push_back(item.misc.uris[i]);
+        infos.push_back(job.mirrors[i]);
+        length = std::max(length, job.mirrors[i].length);
+    }
+
+    /* Don't start what we can't finish; what we got earlier needn't fit twice. */
+    if (length > 0) {
+        std::error_code ec;
+        const uintmax_t have = fs::file_size(part_path(filename), ec);
+        const uintmax_t needed = length - (ec ? 0 : std::min<uintmax_t>(have, length));
+
+        if (utils::validate_download_dir(dldir, needed) == std::errc::no_space_on_device) {
+            log(core::log_level::err, fmt::format("not enough free space in {} for {} ({:.1f}MB)",
+                    dldir.string(), filename.filename().string(), static_cast<double>(needed) / 1024 / 1024));
+            return false;
+        }
+    }
+
+    /* LibGen tells us what the file should hash to. */
+    const string md5 = hash::md5_from_urls(item.misc.uris);
+
+    /*
+     * Large items are split into ranges; if the mirrors won't have it, use a single stream.
+     * If only some ranges arrived, we leave them be for the next attempt to resume.
+     */
+    const auto segmented = segmented_download(uris, infos, filename, resume, md5);
+    bool success = segmented == segmented_result::done ||
+        (segmented == segmented_result::fall_back && single_download(uris, infos, filename, resume, md5));
+
+    if (share_) {
+        log(core::log_level::debug, fmt::format("{}: {} transfers opened {} new connections",
+                filename.filename().string(), share_->transfers() - transfers,
+                share_->connections() - connections));
+    }
+
+    if (success) {
+        std::error_code ec;
+        fs::rename(part_path(filename), filename, ec);
+
+        if (ec) {
+            /* It's all there, so leave it be; the user may move it by hand. */
+            log(core::log_level::err, fmt::format("couldn't move {} into place: {}",
+                    part_path(filename).string(), ec.message()));
+            success = false;
+        } else {
+            fs::remove(journal_path(filename), ec);
+            library_.add(filename, job.md5);
+        }
+    } else if (!cancelled()) {
+        log(core::log_level::err, fmt::format("no good sources for this item: {} - {} ({}). Sorry!",
+            utils::vector_to_string(item.nonexacts.authors),
+            item.nonexacts.title, item.exacts.year));
+    }
+
+    return success;
+}
+
+void downloader::work()
+{
+    using status = download_job::status;
+
+    core::trace::name_thread("downloader");
+
+    while (true) {
+        std::shared_ptr<download_job> job;
+        vector<std::shared_ptr<download_job>> unprobed;
+
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex_);
+            jobs_cv_.wait(lock, [this] { return stop_ || next_job(); });
+            if (stop_) return;
+
+            /* A few at a time, so that a thousand items marked at once don't wait on a thousand HEADs. */
+            for (const auto &j : jobs_) {
+                if (unprobed.size() == max_probed_jobs)
+                    break;
+
+                if (j->state == status::queued && !j->probed)
+                    unprobed.push_back(j);
             }
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, out);
+        }
 
-            if (CURLcode res = curl_easy_perform(curl); res != CURLE_OK) {
-                fmt::print(stderr, "{}error: item download (mirror {}) failed: {} (CURLcode = {})\n",
-                        rune::vt100::erase_line, mirror++, curl_easy_strerror(res), res);
+        /* Learn the sizes of (some of) what was queued since we last looked. */
+        if (!unprobed.empty()) {
+            probe_jobs(unprobed);
 
-                std::fclose(out);
-                if (fs::file_size(filename) == 0)
-                    fs::remove(filename);
+            if (auto fe = frontend_.lock())
+                fe->update();
+        }
 
-            } else {
-                std::fclose(out);
-                any_success = success = true;
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex_);
+            if (stop_) return;
 
-                /* That source worked, so there is no need to download from the others. */
-                break;
+            /* Everything may have been cancelled while we probed. */
+            job = next_job();
+            if (!job) continue;
+
+            job->state = status::downloading;
+            current_ = job.get();
+
+            if (!job->item.misc.uris.empty())
+                host_turns_[host_of(job->item.misc.uris.front())] = ++turn_;
+        }
+
+        bool success = false;
+        {
+            core::trace::span span("download", job->item.nonexacts.title);
+            try {
+                success = download(*job);
+            } catch (const std::exception &err) {
+                /* Nobody is there to catch this on our thread; e.g. a filesystem_error from the library. */
+                log(core::log_level::err, err.what());
             }
+
+            span.set_detail(success ? "done" : "failed");
         }
 
-        if (!success) {
-            fmt::print(stderr, "error: no good sources for this item: {} - {} ({}). Sorry!\n",
-                utils::vector_to_string(item.nonexacts.authors),
-                item.nonexacts.title, item.exacts.year);
+        {
+            std::lock_guard<std::mutex> guard(jobs_mutex_);
+            current_ = nullptr;
+
+            /* Unless the job was cancelled underway, record how it went. */
+            auto expected = status::downloading;
+            job->state.compare_exchange_strong(expected, success ? status::done : status::failed);
         }
+
+        stats_.save();
+
+        jobs_cv_.notify_all();
+
+        if (auto fe = frontend_.lock())
+            fe->update();
     }
+}
+
+std::shared_ptr<download_job> downloader::next_job() const
+{
+    /* Items of unknown size are left for last; the mirrors may know better than the plugin. */
+    const auto size = [](const download_job &job) -> long long {
+        if (job.item.exacts.size != core::empty)
+            return job.item.exacts.size;
+
+        return job.dltotal > 0 ? job.dltotal.load() : std::numeric_limits<long long>::max();
+    };
+
+    /* Hosts we have never downloaded from get the first turn. */
+    const auto last_turn = [this](const download_job &job) -> size_t {
+        if (job.item.misc.uris.empty()) return 0;
+
+        const auto turn = host_turns_.find(host_of(job.item.misc.uris.front()));
+        return turn == host_turns_.cend() ? 0 : turn->second;
+    };
+
+    /* Does a go before b? Ties are broken by queue order, as jobs_ is. */
+    const auto before = [&](const download_job &a, const download_job &b) {
+        if (a.priority != b.priority)
+            return a.priority > b.priority;
 
-    return any_success;
+        switch (policy_) {
+            case queue_policy::smallest:
+                return size(a) < size(b);
+            case queue_policy::hosts:
+                return last_turn(a) < last_turn(b);
+            case queue_policy::fifo:
+                break;
+        }
+
+        return false;
+    };
+
+    std::shared_ptr<download_job> next;
+    for (const auto &job : jobs_) {
+        if (job->state == download_job::status::queued && (!next || before(*job, *next)))
+            next = job;
+    }
+
+    return next;
+}
+
+string downloader::host_of(const string &url)
+{
+    /* scheme://[user@]host[:port]/... */
+    auto start = url.find("://");
+    start = start == string::npos ? 0 : start + 3;
+
+    const auto end = url.find_first_of("/?#", start);
+    string host = url.substr(start, end == string::npos ? string::npos : end - start);
+
+    if (const auto at = host.rfind('@'); at != string::npos)
+        host.erase(0, at + 1);
+
+    return host;
+}
+
+void downloader::change_priority(size_t id, int delta)
+{
+    std::lock_guard<std::mutex> guard(jobs_mutex_);
+
+    if (const auto job = jobs_by_id_.find(id); job != jobs_by_id_.cend())
+        job->second->priority += delta;
+}
+
+bool downloader::enqueue(size_t id, const core::item &item)
+{
+    using status = download_job::status;
+
+    const auto [job, inserted] = jobs_by_id_.try_emplace(id);
+    if (inserted) {
+        job->second = std::make_shared<download_job>(id, item);
+        jobs_.push_back(job->second);
+        return true;
+    }
+
+    if (auto state = job->second->state.load(); state == status::cancelled || state == status::failed) {
+        job->second->state = status::queued;
+        return true;
+    }
+
+    return false;
+}
+
+void downloader::async_download(size_t id, const core::item &item)
+{
+    {
+        std::lock_guard<std::mutex> guard(jobs_mutex_);
+        if (!enqueue(id, item))
+            return;
+    }
+
+    jobs_cv_.notify_all();
+}
+
+void downloader::async_download(const vector<size_t> &ids, const vector<core::item> &items)
+{
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> guard(jobs_mutex_);
+
+        jobs_.reserve(jobs_.size() + ids.size());
+        for (const size_t id : ids) {
+            if (id < items.size())
+                queued |= enqueue(id, items[id]);
+        }
+    }
+
+    if (queued)
+        jobs_cv_.notify_all();
+}
+
+void downloader::cancel_job(size_t id)
+{
+    using status = download_job::status;
+
+    const auto job = jobs_by_id_.find(id);
+    if (job == jobs_by_id_.cend())
+        return;
+
+    if (auto state = job->second->state.load(); state == status::queued || state == status::downloading)
+        job->second->state = status::cancelled;
+}
+
+void downloader::cancel(size_t id)
+{
+    std::lock_guard<std::mutex> guard(jobs_mutex_);
+    cancel_job(id);
+}
+
+void downloader::cancel(const vector<size_t> &ids)
+{
+    std::lock_guard<std::mutex> guard(jobs_mutex_);
+
+    for (const size_t id : ids)
+        cancel_job(id);
+}
+
+void downloader::cancel_all()
+{
+    using status = download_job::status;
+
+    {
+        std::lock_guard<std::mutex> guard(jobs_mutex_);
+
+        for (auto &job : jobs_) {
+            if (auto state = job->state.load(); state == status::queued || state == status::downloading)
+                job->state = status::cancelled;
+        }
+    }
+
+    jobs_cv_.notify_all();
+}
+
+bool downloader::wait()
+{
+    using status = download_job::status;
+    std::unique_lock<std::mutex> lock(jobs_mutex_);
+
+    jobs_cv_.wait(lock, [this] {
+        return std::none_of(jobs_.cbegin(), jobs_.cend(), [](const auto &job) {
+            return job->state == status::queued || job->state == status::downloading;
+        });
+    });
+
+    return std::any_of(jobs_.cbegin(), jobs_.cend(), [](const auto &job) {
+        return job->state == status::done;
+    });
+}
+
+bool downloader::sync_download(vector<core::item> items)
+{
+    vector<size_t> ids(items.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    async_download(ids, items);
+
+    return wait();
+}
+
+vector<std::shared_ptr<const download_job>> downloader::jobs() const
+{
+    std::lock_guard<std::mutex> guard(jobs_mutex_);
+    return {jobs_.cbegin(), jobs_.cend()};
+}
+
+void downloader::log(core::log_level lvl, const string &msg)
+{
+    if (auto fe = frontend_.lock()) {
+        fe->log(lvl, msg);
+        return;
+    }
+
+    /* Don't clutter the terminal with what is only useful in the log. */
+    if (lvl < core::log_level::warn)
+        return;
+
+    fmt::print(stderr, "{}{}: {}\n", rune::vt100::erase_line,
+            lvl >= core::log_level::err ? "error" : "warning", msg);
+}
+
+void downloader::report_progress(curl_off_t dltotal, curl_off_t dlnow, double rate, bool force)
+{
+    if (current_) {
+        if (current_->dlnow == 0 && dlnow > 0)
+            core::trace::instant("download", "first byte", current_->item.nonexacts.title);
+
+        current_->dltotal = dltotal;
+        current_->dlnow = dlnow;
+        current_->rate = rate;
+    }
+
+    if (timer.ms_since_last_update() < 100 && !force)
+        return;
+
+    timer.reset();
+
+    if (auto fe = frontend_.lock())
+        fe->update();
+    else
+        draw_progress(dltotal, dlnow, rate);
 }
 
 int downloader::progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
@@ -158,72 +1191,79 @@ int downloader::progress_callback(void *clientp, curl_off_t dltotal, curl_off_t
      */
     downloader *d = static_cast<downloader*>(clientp);
 
+    /* Returning non-zero aborts the transfer. */
+    if (d->cancelled())
+        return 1;
+
     double rate;
     if (curl_easy_getinfo(d->curl, CURLINFO_SPEED_DOWNLOAD, &rate) != CURLE_OK)
         rate = std::numeric_limits<double>::quiet_NaN();
 
-    if (d->timer.ms_since_last_update() >= 100 || dlnow == dltotal) {
-        d->timer.reset();
-
-        time::duration eta((dltotal - dlnow) / rate);
-        std::stringstream eta_ss;
-        if (eta.hours() > 0) {
-            eta_ss << eta.hours() << "h "
-                   << std::setfill('0') << std::setw(2) << eta.minutes() << "m "
-                   << std::setfill('0') << std::setw(2) << eta.seconds() << "s";
-        } else if (eta.minutes() > 0) {
-            eta_ss << eta.minutes() << "m "
-                   << std::setfill('0') << std::setw(2) << eta.seconds() << "s";
-        } else {
-            eta_ss << eta.seconds() << "s";
-        }
+    /* Count what we got before resuming towards the item's progress. */
+    const curl_off_t resumed = dltotal > 0 ? d->resumed_from_ : 0;
+    d->report_progress(dltotal + resumed, dlnow + resumed, rate, dltotal > 0 && dlnow == dltotal);
 
-        /* Download rate unit conversion. */
-        const string rate_unit = [&rate]() {
-            constexpr auto k = 1024,
-                           M = 1048576;
+    return 0;
+}
 
-            if (rate > M) {
-                rate /= M;
-                return "MB/s";
-            } else {
-                rate /= k;
-                return "kB/s";
-            }
-        }();
+void downloader::draw_progress(curl_off_t dltotal, curl_off_t dlnow, double rate)
+{
+    time::duration eta((dltotal - dlnow) / rate);
+    std::stringstream eta_ss;
+    if (eta.hours() > 0) {
+        eta_ss << eta.hours() << "h "
+               << std::setfill('0') << std::setw(2) << eta.minutes() << "m "
+               << std::setfill('0') << std::setw(2) << eta.seconds() << "s";
+    } else if (eta.minutes() > 0) {
+        eta_ss << eta.minutes() << "m "
+               << std::setfill('0') << std::setw(2) << eta.seconds() << "s";
+    } else {
+        eta_ss << eta.seconds() << "s";
+    }
+
+    /* Download rate unit conversion. */
+    const string rate_unit = [&rate]() {
+        constexpr auto k = 1024,
+                       M = 1048576;
 
-        const double fraction = static_cast<double>(dlnow) / static_cast<double>(dltotal);
-        fmt::print("{}\r  {:.0f}% ", rune::vt100::erase_line, fraction * 100);
+        if (rate > M) {
+            rate /= M;
+            return "MB/s";
+        } else {
+            rate /= k;
+            return "kB/s";
+        }
+    }();
 
-        string status_text = fmt::format(" {dlnow:.2f}/{dltotal:.2f}MB @ {rate:.2f}{unit} ETA: {eta}\r",
-                fmt::arg("dlnow",   static_cast<double>(dlnow)/1024/1024),
-                fmt::arg("dltotal", static_cast<double>(dltotal)/1024/1024),
-                fmt::arg("rate",    rate),
-                fmt::arg("unit",    rate_unit),
-                fmt::arg("eta",     eta_ss.str()));
+    const double fraction = static_cast<double>(dlnow) / static_cast<double>(dltotal);
+    fmt::print("{}\r  {:.0f}% ", rune::vt100::erase_line, fraction * 100);
 
-        /* Draw the progress bar. */
-        const int term_width = []() {
-            struct winsize w;
-            ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-            return w.ws_col;
-        }();
+    string status_text = fmt::format(" {dlnow:.2f}/{dltotal:.2f}MB @ {rate:.2f}{unit} ETA: {eta}\r",
+            fmt::arg("dlnow",   static_cast<double>(dlnow)/1024/1024),
+            fmt::arg("dltotal", static_cast<double>(dltotal)/1024/1024),
+            fmt::arg("rate",    rate),
+            fmt::arg("unit",    rate_unit),
+            fmt::arg("eta",     eta_ss.str()));
 
-        int bar_length = 26,
-            min_bar_length = 5,
-            status_text_length = status_text.length() + 6;
+    /* Draw the progress bar. */
+    const int term_width = []() {
+        struct winsize w;
+        ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+        return w.ws_col;
+    }();
 
-        if (status_text_length + bar_length > term_width)
-            bar_length -= status_text_length + bar_length - term_width;
+    int bar_length = 26,
+        min_bar_length = 5,
+        status_text_length = status_text.length() + 6;
 
-        /* Don't draw the progress bar if length is less than min_bar_length. */
-        if (bar_length >= min_bar_length)
-            d->pbar.draw(bar_length, fraction);
+    if (status_text_length + bar_length > term_width)
+        bar_length -= status_text_length + bar_length - term_width;
 
-        std::cout << status_text << std::flush;
-    }
+    /* Don't draw the progress bar if length is less than min_bar_length. */
+    if (bar_length >= min_bar_length)
+        pbar.draw(bar_length, fraction);
 
-    return 0;
+    std::cout << status_text << std::flush;
 }
 
 string progressbar::build_bar(unsigned int length, double fraction)
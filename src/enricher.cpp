@@ -0,0 +1,380 @@
+#include <cmath>
+#include <cctype>
+#include <limits>
+#include <algorithm>
+
+#include <zlib.h>
+#include <fmt/format.h>
+
+#include "enricher.hpp"
+#include "hash.hpp"
+#include "json.hpp"
+#include "utils.hpp"
+
+namespace bookwyrm {
+
+namespace {
+
+string url_encode(const string &str)
+{
+    string encoded;
+    for (const unsigned char c : str) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+            encoded += c;
+        else
+            encoded += fmt::format("%{:02X}", c);
+    }
+
+    return encoded;
+}
+
+/* Open Library gives a description either as a string or as {"type": ..., "value": "..."}. */
+string description_of(const json::value &val)
+{
+    return val.str(val["value"].str());
+}
+
+vector<string> strings_of(const json::value &val, size_t max = 10)
+{
+    vector<string> strs;
+    for (const auto &e : val.elements()) {
+        if (strs.size() == max)
+            break;
+
+        /* Editions list subjects as strings, or as {"name": ...}. */
+        if (string s = e.str(e["name"].str()); !s.empty())
+            strs.push_back(std::move(s));
+    }
+
+    return strs;
+}
+
+/* A page count, or 0 if it's missing or no page count at all (negative, NaN, or too large for an int). */
+int pages_of(const json::value &val)
+{
+    const double pages = val.number();
+    if (!std::isfinite(pages) || pages < 0 || pages > std::numeric_limits<int>::max())
+        return 0;
+
+    return static_cast<int>(pages);
+}
+
+json::value to_json(const item_info &info)
+{
+    json::array subjects;
+    for (const auto &s : info.subjects)
+        subjects.push_back({s});
+
+    json::object obj;
+    obj["description"] = {info.description};
+    obj["subjects"] = {std::move(subjects)};
+    obj["pages"] = {static_cast<double>(info.pages)};
+
+    return {std::move(obj)};
+}
+
+item_info from_json(const json::value &val)
+{
+    item_info info;
+    info.description = val["description"].str();
+    info.subjects = strings_of(val["subjects"], std::numeric_limits<size_t>::max());
+    info.pages = pages_of(val["pages"]);
+
+    return info;
+}
+
+/* ns anonymous */
+}
+
+fs::path enricher::default_cache_dir()
+{
+    if (const auto dir = utils::cache_dir(); !dir.empty())
+        return dir / "details";
+
+    return {};
+}
+
+enricher::enricher(std::shared_ptr<core::http_share> share, string base_url, fs::path cache_dir, size_t capacity)
+    : share_(share), base_url_(std::move(base_url)), cache_dir_(std::move(cache_dir)),
+    capacity_(std::max<size_t>(capacity, 1))
+{
+    worker_ = std::thread(&enricher::work, this);
+}
+
+enricher::~enricher()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+    }
+
+    cv_.notify_all();
+    worker_.join();
+}
+
+string enricher::key_of(const core::item &item)
+{
+    for (const auto &isbn : item.misc.isbns) {
+        string digits;
+        std::copy_if(isbn.cbegin(), isbn.cend(), std::back_inserter(digits), [](unsigned char c) {
+            return std::isdigit(c) || c == 'X' || c == 'x';
+        });
+
+        if (digits.length() == 10 || digits.length() == 13)
+            return "isbn:" + digits;
+    }
+
+    string title = item.nonexacts.title;
+    std::transform(title.begin(), title.end(), title.begin(), ::tolower);
+    return "title:" + title;
+}
+
+void enricher::request(const core::item &item)
+{
+    enqueue(item, true);
+}
+
+void enricher::prefetch(const core::item &item)
+{
+    enqueue(item, false);
+}
+
+void enricher::enqueue(const core::item &item, bool urgent)
+{
+    const string key = key_of(item);
+    if (key == "title:")
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (cache_.count(key))
+            return;
+
+        if (pending_.count(key)) {
+            /* Already guessed at; but the user wants it now. */
+            if (const auto guessed = std::find(prefetches_.begin(), prefetches_.end(), key);
+                    urgent && guessed != prefetches_.end()) {
+                prefetches_.erase(guessed);
+                requests_.push_back(key);
+            }
+
+            return;
+        }
+
+        pending_.insert(key);
+
+        if (urgent) {
+            requests_.push_back(key);
+        } else {
+            prefetches_.push_back(key);
+
+            /* The user has scrolled on; forget the oldest guesses. */
+            if (prefetches_.size() > max_prefetches) {
+                pending_.erase(prefetches_.front());
+                prefetches_.pop_front();
+            }
+        }
+    }
+
+    cv_.notify_one();
+}
+
+std::pair<enricher::status, item_info> enricher::get(const core::item &item)
+{
+    const string key = key_of(item);
+
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    if (const auto cached = cache_.find(key); cached != cache_.cend()) {
+        /* Most recently used. */
+        lru_.splice(lru_.begin(), lru_, cached->second);
+        return cached->second->second;
+    }
+
+    return {pending_.count(key) ? status::pending : status::unknown, {}};
+}
+
+void enricher::work()
+{
+    while (true) {
+        string key;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !requests_.empty() || !prefetches_.empty(); });
+            if (stop_) return;
+
+            /* Requests in order; then the latest guess, which is nearest where the user is now. */
+            if (!requests_.empty()) {
+                key = requests_.front();
+                requests_.pop_front();
+            } else {
+                key = prefetches_.back();
+                prefetches_.pop_back();
+            }
+        }
+
+        auto result = load(key);
+
+        if (!result) {
+            try {
+                if (auto info = fetch(key))
+                    result.emplace(status::found, std::move(*info));
+                else
+                    result.emplace(status::not_found, item_info{});
+
+                save(key, *result);
+            } catch (const std::runtime_error&) {
+                /* Unreachable or garbled; try again some other time. */
+            }
+        }
+
+        std::function<void()> callback;
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            pending_.erase(key);
+
+            if (result)
+                remember(key, result->first, std::move(result->second));
+
+            callback = callback_;
+        }
+
+        if (callback)
+            callback();
+    }
+}
+
+void enricher::remember(const string &key, status st, item_info info)
+{
+    lru_.emplace_front(key, std::make_pair(st, std::move(info)));
+    cache_[key] = lru_.begin();
+
+    if (lru_.size() > capacity_) {
+        cache_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+}
+
+std::optional<item_info> enricher::fetch(const string &key)
+{
+    const auto get = [this](const string &path) {
+        return json::parse(core::http_get(base_url_ + path, share_.get()));
+    };
+
+    item_info info;
+    string work;
+
+    if (key.compare(0, 5, "isbn:") == 0) {
+        json::value edition;
+        try {
+            edition = get("/isbn/" + key.substr(5) + ".json");
+        } catch (const core::http_error &err) {
+            /* Open Library answers 404 for an ISBN it doesn't know. */
+            if (err.status == 404)
+                return std::nullopt;
+            throw;
+        }
+
+        info.description = description_of(edition["description"]);
+        info.subjects = strings_of(edition["subjects"]);
+        info.pages = pages_of(edition["number_of_pages"]);
+        work = edition["works"][0]["key"].str();
+    } else {
+        const json::value found = get("/search.json?limit=1&title=" + url_encode(key.substr(6)));
+        const json::value &doc = found["docs"][0];
+        if (doc.is_null())
+            return std::nullopt;
+
+        info.subjects = strings_of(doc["subject"]);
+        info.pages = pages_of(doc["number_of_pages_median"]);
+        work = doc["key"].str();
+    }
+
+    /* The description is usually only given for the work, not each edition of it. */
+    if (info.description.empty() && work.compare(0, 7, "/works/") == 0) {
+        const json::value w = get(work + ".json");
+
+        info.description = description_of(w["description"]);
+        if (info.subjects.empty())
+            info.subjects = strings_of(w["subjects"]);
+    }
+
+    return info;
+}
+
+fs::path enricher::path_of(const string &key) const
+{
+    hash::md5 md5;
+    md5.update(key.data(), key.length());
+    return cache_dir_ / (md5.hexdigest() + ".json.gz");
+}
+
+std::optional<std::pair<enricher::status, item_info>> enricher::load(const string &key) const
+{
+    if (cache_dir_.empty())
+        return std::nullopt;
+
+    gzFile file = gzopen(path_of(key).c_str(), "rb");
+    if (!file)
+        return std::nullopt;
+
+    string text;
+    char buf[4096];
+    int len;
+    while ((len = gzread(file, buf, sizeof(buf))) > 0)
+        text.append(buf, len);
+
+    const bool ok = len == 0;
+    gzclose(file);
+    if (!ok)
+        return std::nullopt;
+
+    try {
+        const json::value val = json::parse(text);
+
+        /* Two keys may share an MD5 in theory; don't mix their details up. */
+        if (val["key"].str() != key)
+            return std::nullopt;
+
+        /* A miss is saved without info. */
+        if (val["info"].is_null())
+            return std::make_pair(status::not_found, item_info{});
+
+        return std::make_pair(status::found, from_json(val["info"]));
+    } catch (const value_error&) {
+        return std::nullopt;
+    }
+}
+
+void enricher::save(const string &key, const std::pair<status, item_info> &result) const
+{
+    if (cache_dir_.empty())
+        return;
+
+    std::error_code ec;
+    fs::create_directories(cache_dir_, ec);
+
+    json::object obj;
+    obj["key"] = {key};
+    if (result.first == status::found)
+        obj["info"] = to_json(result.second);
+    const string text = json::dump({std::move(obj)});
+
+    /* Written aside and renamed, so that a reader never sees half of it. */
+    const fs::path path = path_of(key), tmp = path.string() + ".tmp";
+
+    gzFile file = gzopen(tmp.c_str(), "wb");
+    if (!file)
+        return;
+
+    const bool ok = gzwrite(file, text.data(), text.length()) == static_cast<int>(text.length());
+    if (gzclose(file) != Z_OK || !ok) {
+        fs::remove(tmp, ec);
+        return;
+    }
+
+    fs::rename(tmp, path, ec);
+}
+
+/* ns bookwyrm */
+}
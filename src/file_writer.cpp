@@ -0,0 +1,236 @@
+#include <cerrno>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "file_writer.hpp"
+
+namespace bookwyrm {
+
+file_writer::file_writer(int fd, hash::digest &digest, const vector<range> &existing)
+    : fd_(fd), digest_(digest)
+{
+    for (const auto &[start, end] : existing) {
+        if (start < end)
+            mark_written(start, end);
+    }
+
+    thread_ = std::thread(&file_writer::work, this);
+}
+
+file_writer::~file_writer()
+{
+    finish();
+
+    for (char *data : free_)
+        std::free(data);
+}
+
+bool file_writer::preallocate(int fd, std::int64_t length)
+{
+    /* Not all file systems support fallocate; a sparse file is better than nothing. */
+    return posix_fallocate(fd, 0, length) == 0 || ftruncate(fd, length) == 0;
+}
+
+char* file_writer::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !free_.empty() || allocated_ < max_buffers || failed_; });
+
+    if (failed_) return nullptr;
+
+    if (!free_.empty()) {
+        char *data = free_.back();
+        free_.pop_back();
+        return data;
+    }
+
+    char *data = static_cast<char*>(std::aligned_alloc(4096, buffer_size));
+    if (!data) {
+        failed_ = true;
+        return nullptr;
+    }
+
+    allocated_++;
+    return data;
+}
+
+void file_writer::submit(const buffer &buf)
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+
+        if (buf.len == 0)
+            free_.push_back(buf.data);
+        else
+            full_.push_back(buf);
+    }
+
+    cv_.notify_all();
+}
+
+bool file_writer::write(const char *data, size_t len, std::int64_t offset)
+{
+    if (failed_) return false;
+
+    /* Continue the buffer that ends where this write begins, if any. */
+    auto buf = std::find_if(open_.begin(), open_.end(), [offset](const buffer &b) {
+        return b.offset + static_cast<std::int64_t>(b.len) == offset;
+    });
+
+    if (buf == open_.end()) {
+        if (open_.size() == max_open) {
+            submit(open_.front());
+            open_.erase(open_.begin());
+        }
+
+        char *mem = acquire();
+        if (!mem) return false;
+
+        open_.push_back({mem, 0, offset});
+        buf = open_.end() - 1;
+    }
+
+    while (len > 0) {
+        const size_t n = std::min(len, buffer_size - buf->len);
+        std::memcpy(buf->data + buf->len, data, n);
+        buf->len += n;
+        data += n;
+        len -= n;
+
+        if (buf->len == buffer_size) {
+            /* Submitted, it's no longer ours; finish() mustn't submit it again. */
+            const std::int64_t next = buf->offset + static_cast<std::int64_t>(buffer_size);
+            submit(*buf);
+            open_.erase(buf);
+
+            char *mem = acquire();
+            if (!mem) return false;
+
+            open_.push_back({mem, 0, next});
+            buf = open_.end() - 1;
+        }
+    }
+
+    return !failed_;
+}
+
+bool file_writer::finish()
+{
+    if (!thread_.joinable())
+        return !failed_;
+
+    for (const auto &buf : open_)
+        submit(buf);
+    open_.clear();
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+    }
+
+    cv_.notify_all();
+    thread_.join();
+
+    return !failed_;
+}
+
+void file_writer::mark_written(std::int64_t start, std::int64_t end)
+{
+    /* Merge with any range that overlaps or touches [start, end). */
+    auto it = written_.upper_bound(start);
+    if (it != written_.begin() && std::prev(it)->second >= start)
+        --it;
+
+    while (it != written_.end() && it->first <= end) {
+        start = std::min(start, it->first);
+        end = std::max(end, it->second);
+        it = written_.erase(it);
+    }
+
+    written_.emplace(start, end);
+}
+
+std::int64_t file_writer::written_until(std::int64_t from) const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    auto it = written_.upper_bound(from);
+    if (it == written_.begin()) return from;
+
+    --it;
+    return it->second >= from ? it->second : from;
+}
+
+bool file_writer::catch_up(const buffer *buf)
+{
+    /* The buffer we just wrote continues the hash; no need to read it back. */
+    if (buf && buf->offset == hashed_) {
+        digest_.update(buf->data, buf->len);
+        hashed_ += buf->len;
+    }
+
+    const std::int64_t until = written_until(hashed_);
+    vector<char> chunk;
+
+    while (hashed_ < until) {
+        chunk.resize(buffer_size);
+        const ssize_t n = pread(fd_, chunk.data(), std::min<std::int64_t>(buffer_size, until - hashed_), hashed_);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        digest_.update(chunk.data(), n);
+        hashed_ += n;
+    }
+
+    return true;
+}
+
+void file_writer::work()
+{
+    if (!catch_up())
+        failed_ = true;
+
+    while (true) {
+        buffer buf;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return !full_.empty() || stop_; });
+            if (full_.empty()) return;
+
+            buf = full_.front();
+            full_.pop_front();
+        }
+
+        size_t written = 0;
+        while (!failed_ && written < buf.len) {
+            const ssize_t n = pwrite(fd_, buf.data + written, buf.len - written, buf.offset + written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) failed_ = true;
+            else written += n;
+        }
+
+        if (!failed_) {
+            {
+                std::lock_guard<std::mutex> guard(mutex_);
+                mark_written(buf.offset, buf.offset + buf.len);
+            }
+
+            if (!catch_up(&buf))
+                failed_ = true;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            free_.push_back(buf.data);
+        }
+
+        cv_.notify_all();
+    }
+}
+
+/* ns bookwyrm */
+}
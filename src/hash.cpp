@@ -0,0 +1,338 @@
+#include <cstring>
+#include <regex>
+#include <algorithm>
+
+#if defined(__SHA__) && defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#include <fmt/format.h>
+
+#include "hash.hpp"
+
+namespace bookwyrm::hash {
+
+/* Format a number of bytes as lowercase hex. */
+template <size_t N>
+static string to_hex(const std::array<uint8_t, N> &bytes)
+{
+    string hex;
+    for (const auto byte : bytes)
+        hex += fmt::format("{:02x}", byte);
+
+    return hex;
+}
+
+static inline uint32_t rotl(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t rotr(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+/*
+ * MD5, as described in RFC 1321. There is little to vectorize here: every
+ * step depends on the previous one, so we only process whole blocks straight
+ * from the caller's buffer whenever we can.
+ */
+
+static constexpr std::array<uint32_t, 64> md5_k = {{
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+}};
+
+static constexpr std::array<int, 64> md5_shift = {{
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+}};
+
+md5::md5()
+    : state_{{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476}}
+{
+
+}
+
+void md5::transform(const uint8_t *block)
+{
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = static_cast<uint32_t>(block[i * 4])
+             | static_cast<uint32_t>(block[i * 4 + 1]) << 8
+             | static_cast<uint32_t>(block[i * 4 + 2]) << 16
+             | static_cast<uint32_t>(block[i * 4 + 3]) << 24;
+    }
+
+    uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t f;
+        int g;
+
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+
+        const uint32_t tmp = d;
+        d = c;
+        c = b;
+        b = b + rotl(a + f + md5_k[i] + m[g], md5_shift[i]);
+        a = tmp;
+    }
+
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+}
+
+void md5::update(const char *data, size_t len)
+{
+    const auto *bytes = reinterpret_cast<const uint8_t*>(data);
+    size_t buffered = length_ % 64;
+    length_ += len;
+
+    /* Top up a partially filled block first. */
+    if (buffered > 0) {
+        const size_t fill = std::min(len, 64 - buffered);
+        std::memcpy(buffer_.data() + buffered, bytes, fill);
+        bytes += fill;
+        len -= fill;
+
+        if (buffered + fill < 64) return;
+        transform(buffer_.data());
+    }
+
+    for (; len >= 64; bytes += 64, len -= 64)
+        transform(bytes);
+
+    std::memcpy(buffer_.data(), bytes, len);
+}
+
+string md5::hexdigest()
+{
+    const uint64_t bits = length_ * 8;
+
+    /* Pad with a single set bit, zeroes and the message length in bits. */
+    const char pad[64] = { static_cast<char>(0x80) };
+    const size_t buffered = length_ % 64;
+    update(pad, buffered < 56 ? 56 - buffered : 120 - buffered);
+
+    char len[8];
+    for (int i = 0; i < 8; i++)
+        len[i] = static_cast<char>(bits >> (8 * i));
+    update(len, 8);
+
+    std::array<uint8_t, 16> out;
+    for (int i = 0; i < 16; i++)
+        out[i] = static_cast<uint8_t>(state_[i / 4] >> (8 * (i % 4)));
+
+    return to_hex(out);
+}
+
+/*
+ * SHA-256, as described in FIPS 180-4. With -march=native on a CPU with the
+ * SHA extensions the compression function runs on the dedicated instructions,
+ * which is several times faster than the portable version below.
+ */
+
+alignas(16) static constexpr std::array<uint32_t, 64> sha256_k = {{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+}};
+
+sha256::sha256()
+    : state_{{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+              0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}}
+{
+
+}
+
+#if defined(__SHA__) && defined(__SSE4_1__)
+
+void sha256::transform(const uint8_t *blocks, size_t count)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    /* The instructions want the state as ABEF and CDGH. */
+    __m128i tmp    = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state_[0])), 0xB1),
+            state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state_[4])), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; count > 0; count--, blocks += 64) {
+        const __m128i abef = state0, cdgh = state1;
+        __m128i msg[4];
+
+        /* Four rounds at a time, extending the message schedule as we go. */
+        for (int i = 0; i < 16; i++) {
+            __m128i &w = msg[i % 4];
+
+            if (i < 4) {
+                w = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)), mask);
+            } else {
+                w = _mm_add_epi32(_mm_sha256msg1_epu32(w, msg[(i + 1) % 4]),
+                        _mm_alignr_epi8(msg[(i + 3) % 4], msg[(i + 2) % 4], 4));
+                w = _mm_sha256msg2_epu32(w, msg[(i + 3) % 4]);
+            }
+
+            __m128i wk = _mm_add_epi32(w, _mm_load_si128(reinterpret_cast<const __m128i*>(&sha256_k[4 * i])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+            wk = _mm_shuffle_epi32(wk, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    /* And back to ABCD and EFGH. */
+    tmp    = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state_[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state_[4]), state1);
+}
+
+#else
+
+void sha256::transform(const uint8_t *blocks, size_t count)
+{
+    for (; count > 0; count--, blocks += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = static_cast<uint32_t>(blocks[i * 4]) << 24
+                 | static_cast<uint32_t>(blocks[i * 4 + 1]) << 16
+                 | static_cast<uint32_t>(blocks[i * 4 + 2]) << 8
+                 | static_cast<uint32_t>(blocks[i * 4 + 3]);
+        }
+
+        for (int i = 16; i < 64; i++) {
+            const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3),
+                           s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3],
+                 e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+
+        for (int i = 0; i < 64; i++) {
+            const uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25),
+                           ch = (e & f) ^ (~e & g),
+                           t1 = h + s1 + ch + sha256_k[i] + w[i],
+                           s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22),
+                           maj = (a & b) ^ (a & c) ^ (b & c),
+                           t2 = s0 + maj;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state_[0] += a;
+        state_[1] += b;
+        state_[2] += c;
+        state_[3] += d;
+        state_[4] += e;
+        state_[5] += f;
+        state_[6] += g;
+        state_[7] += h;
+    }
+}
+
+#endif
+
+void sha256::update(const char *data, size_t len)
+{
+    const auto *bytes = reinterpret_cast<const uint8_t*>(data);
+    size_t buffered = length_ % 64;
+    length_ += len;
+
+    if (buffered > 0) {
+        const size_t fill = std::min(len, 64 - buffered);
+        std::memcpy(buffer_.data() + buffered, bytes, fill);
+        bytes += fill;
+        len -= fill;
+
+        if (buffered + fill < 64) return;
+        transform(buffer_.data(), 1);
+    }
+
+    /* Hash all whole blocks straight from the caller's buffer. */
+    transform(bytes, len / 64);
+    bytes += len - len % 64;
+
+    std::memcpy(buffer_.data(), bytes, len % 64);
+}
+
+string sha256::hexdigest()
+{
+    const uint64_t bits = length_ * 8;
+
+    const char pad[64] = { static_cast<char>(0x80) };
+    const size_t buffered = length_ % 64;
+    update(pad, buffered < 56 ? 56 - buffered : 120 - buffered);
+
+    /* Unlike MD5, the length is big endian. */
+    char len[8];
+    for (int i = 0; i < 8; i++)
+        len[i] = static_cast<char>(bits >> (56 - 8 * i));
+    update(len, 8);
+
+    std::array<uint8_t, 32> out;
+    for (int i = 0; i < 32; i++)
+        out[i] = static_cast<uint8_t>(state_[i / 4] >> (24 - 8 * (i % 4)));
+
+    return to_hex(out);
+}
+
+string md5_from_urls(const vector<string> &urls)
+{
+    static const std::regex md5_re("(?:[?&]md5=|/md5/)([0-9a-fA-F]{32})(?:[^0-9a-fA-F]|$)");
+
+    for (const auto &url : urls) {
+        if (std::smatch match; std::regex_search(url, match, md5_re)) {
+            string md5 = match[1];
+            std::transform(md5.begin(), md5.end(), md5.begin(), ::tolower);
+            return md5;
+        }
+    }
+
+    return "";
+}
+
+/* ns hash */
+}
@@ -0,0 +1,76 @@
+#include <fstream>
+#include <sstream>
+
+#include "journal.hpp"
+
+namespace bookwyrm {
+
+/*
+ * The journal is a plain text file with one field per line:
+ *
+ *   url <url>
+ *   etag <etag>
+ *   length <bytes>
+ *   offset <bytes>
+ *   range <start> <offset> <end>
+ *
+ * where range may occur any number of times.
+ */
+std::optional<journal> journal::read(const fs::path &path)
+{
+    std::ifstream in(path);
+    if (!in) return std::nullopt;
+
+    journal j;
+    string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        string key;
+        fields >> key;
+
+        if (key == "url")
+            fields >> j.url;
+        else if (key == "etag")
+            fields >> j.etag;
+        else if (key == "length")
+            fields >> j.length;
+        else if (key == "offset")
+            fields >> j.offset;
+        else if (key == "range") {
+            range r;
+            fields >> r.start >> r.offset >> r.end;
+            j.ranges.push_back(r);
+        } else {
+            return std::nullopt;
+        }
+
+        if (fields.fail()) return std::nullopt;
+    }
+
+    if (j.url.empty()) return std::nullopt;
+    return j;
+}
+
+void journal::write(const fs::path &path) const
+{
+    /* Write to a temporary file first, so that a crash never leaves half a journal behind. */
+    const fs::path tmp = fs::path(path).concat(".tmp");
+
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << "url " << url << '\n';
+        if (!etag.empty())
+            out << "etag " << etag << '\n';
+        out << "length " << length << '\n'
+            << "offset " << offset << '\n';
+
+        for (const auto &r : ranges)
+            out << "range " << r.start << ' ' << r.offset << ' ' << r.end << '\n';
+    }
+
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+}
+
+/* ns bookwyrm */
+}
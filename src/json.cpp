@@ -0,0 +1,339 @@
+#include <cmath>
+#include <cstdlib>
+
+#include <fmt/format.h>
+
+#include "json.hpp"
+
+namespace json {
+
+namespace {
+
+const value null_value{};
+const array no_elements{};
+
+class parser {
+public:
+    explicit parser(const string_view &text)
+        : text_(text) {}
+
+    value parse()
+    {
+        value val = parse_value();
+
+        skip_whitespace();
+        if (pos_ != text_.length())
+            fail("trailing characters");
+
+        return val;
+    }
+
+private:
+    const string_view text_;
+    size_t pos_ = 0;
+
+    /* Nested any deeper than this and it's not something we asked for. */
+    static constexpr int max_depth = 128;
+    int depth_ = 0;
+
+    [[noreturn]] void fail(const string &what) const
+    {
+        throw value_error(fmt::format("malformed JSON at offset {}: {}", pos_, what));
+    }
+
+    void skip_whitespace()
+    {
+        while (pos_ < text_.length() && (text_[pos_] == ' ' || text_[pos_] == '\t' ||
+                    text_[pos_] == '\n' || text_[pos_] == '\r'))
+            pos_++;
+    }
+
+    char peek()
+    {
+        skip_whitespace();
+        if (pos_ == text_.length())
+            fail("unexpected end");
+
+        return text_[pos_];
+    }
+
+    void expect(const string_view &word)
+    {
+        if (text_.substr(pos_, word.length()) != word)
+            fail(fmt::format("expected '{}'", string(word)));
+
+        pos_ += word.length();
+    }
+
+    value parse_value()
+    {
+        if (++depth_ > max_depth)
+            fail("nested too deep");
+
+        value val;
+        switch (peek()) {
+            case '{': val.v = parse_object(); break;
+            case '[': val.v = parse_array();  break;
+            case '"': val.v = parse_string(); break;
+            case 't': expect("true");  val.v = true;  break;
+            case 'f': expect("false"); val.v = false; break;
+            case 'n': expect("null");  val.v = nullptr; break;
+            default:  val.v = parse_number();
+        }
+
+        depth_--;
+        return val;
+    }
+
+    object parse_object()
+    {
+        object obj;
+        pos_++;
+
+        if (peek() == '}') {
+            pos_++;
+            return obj;
+        }
+
+        while (true) {
+            if (peek() != '"')
+                fail("expected a member name");
+
+            string key = parse_string();
+            if (peek() != ':')
+                fail("expected ':'");
+            pos_++;
+
+            obj[std::move(key)] = parse_value();
+
+            const char next = peek();
+            pos_++;
+            if (next == '}') return obj;
+            if (next != ',') fail("expected ',' or '}'");
+        }
+    }
+
+    array parse_array()
+    {
+        array arr;
+        pos_++;
+
+        if (peek() == ']') {
+            pos_++;
+            return arr;
+        }
+
+        while (true) {
+            arr.push_back(parse_value());
+
+            const char next = peek();
+            pos_++;
+            if (next == ']') return arr;
+            if (next != ',') fail("expected ',' or ']'");
+        }
+    }
+
+    unsigned hex4()
+    {
+        if (pos_ + 4 > text_.length())
+            fail("truncated escape");
+
+        unsigned code = 0;
+        for (int i = 0; i < 4; i++) {
+            const char c = text_[pos_++];
+            code <<= 4;
+            if (c >= '0' && c <= '9')      code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else fail("bad escape");
+        }
+
+        return code;
+    }
+
+    static void append_utf8(string &str, unsigned code)
+    {
+        if (code < 0x80) {
+            str += static_cast<char>(code);
+        } else if (code < 0x800) {
+            str += static_cast<char>(0xC0 | (code >> 6));
+            str += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            str += static_cast<char>(0xE0 | (code >> 12));
+            str += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            str += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            str += static_cast<char>(0xF0 | (code >> 18));
+            str += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            str += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            str += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    string parse_string()
+    {
+        string str;
+        pos_++;
+
+        while (true) {
+            if (pos_ >= text_.length())
+                fail("unterminated string");
+
+            const char c = text_[pos_++];
+            if (c == '"')
+                return str;
+
+            if (c != '\\') {
+                str += c;
+                continue;
+            }
+
+            if (pos_ >= text_.length())
+                fail("unterminated string");
+
+            switch (const char esc = text_[pos_++]; esc) {
+                case '"': case '\\': case '/': str += esc; break;
+                case 'b': str += '\b'; break;
+                case 'f': str += '\f'; break;
+                case 'n': str += '\n'; break;
+                case 'r': str += '\r'; break;
+                case 't': str += '\t'; break;
+                case 'u': {
+                    unsigned code = hex4();
+
+                    /* A surrogate pair. */
+                    if (code >= 0xD800 && code <= 0xDBFF && text_.substr(pos_, 2) == "\\u") {
+                        pos_ += 2;
+                        const unsigned low = hex4();
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+
+                    append_utf8(str, code);
+                    break;
+                }
+                default:
+                    fail("bad escape");
+            }
+        }
+    }
+
+    double parse_number()
+    {
+        const string rest(text_.substr(pos_, 64));
+        char *end = nullptr;
+        const double number = std::strtod(rest.c_str(), &end);
+
+        if (end == rest.c_str() || !std::isfinite(number))
+            fail("expected a value");
+
+        pos_ += end - rest.c_str();
+        return number;
+    }
+};
+
+void dump_string(string &out, const string &str)
+{
+    out += '"';
+    for (const char c : str) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                    out += fmt::format("\\u{:04x}", static_cast<int>(c));
+                else
+                    out += c;
+        }
+    }
+    out += '"';
+}
+
+void dump_value(string &out, const value &val)
+{
+    std::visit([&out](const auto &v) {
+        using T = std::decay_t<decltype(v)>;
+
+        if constexpr (std::is_same_v<T, std::nullptr_t>) {
+            out += "null";
+        } else if constexpr (std::is_same_v<T, bool>) {
+            out += v ? "true" : "false";
+        } else if constexpr (std::is_same_v<T, double>) {
+            out += fmt::format("{}", v);
+        } else if constexpr (std::is_same_v<T, string>) {
+            dump_string(out, v);
+        } else if constexpr (std::is_same_v<T, array>) {
+            out += '[';
+            for (size_t i = 0; i < v.size(); i++) {
+                if (i > 0) out += ',';
+                dump_value(out, v[i]);
+            }
+            out += ']';
+        } else {
+            out += '{';
+            for (auto member = v.cbegin(); member != v.cend(); ++member) {
+                if (member != v.cbegin()) out += ',';
+                dump_string(out, member->first);
+                out += ':';
+                dump_value(out, member->second);
+            }
+            out += '}';
+        }
+    }, val.v);
+}
+
+/* ns anonymous */
+}
+
+const value& value::operator[](const string &key) const
+{
+    if (const auto obj = std::get_if<object>(&v)) {
+        if (const auto member = obj->find(key); member != obj->cend())
+            return member->second;
+    }
+
+    return null_value;
+}
+
+const value& value::operator[](size_t idx) const
+{
+    if (const auto arr = std::get_if<array>(&v); arr && idx < arr->size())
+        return (*arr)[idx];
+
+    return null_value;
+}
+
+string value::str(const string &fallback) const
+{
+    const auto s = std::get_if<string>(&v);
+    return s ? *s : fallback;
+}
+
+double value::number(double fallback) const
+{
+    const auto n = std::get_if<double>(&v);
+    return n ? *n : fallback;
+}
+
+const array& value::elements() const
+{
+    const auto arr = std::get_if<array>(&v);
+    return arr ? *arr : no_elements;
+}
+
+value parse(const string_view &text)
+{
+    return parser(text).parse();
+}
+
+string dump(const value &val)
+{
+    string out;
+    dump_value(out, val);
+    return out;
+}
+
+/* ns json */
+}
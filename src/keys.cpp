@@ -6,11 +6,8 @@ static tb_event tb_ev;
 
 namespace keys {
 
-bool poll_event(event &ev)
+static void copy_event(event &ev)
 {
-    if (!tb_poll_event(&tb_ev))
-        return false;
-
     ev.type = type(tb_ev.type);
     ev.key  = key(tb_ev.key);
     ev.ch   = tb_ev.ch;
@@ -19,9 +16,25 @@ bool poll_event(event &ev)
     ev.h    = tb_ev.h;
     ev.x    = tb_ev.x;
     ev.y    = tb_ev.y;
+}
+
+bool poll_event(event &ev)
+{
+    if (!tb_poll_event(&tb_ev))
+        return false;
 
+    copy_event(ev);
     return true;
 }
 
+int peek_event(event &ev, int timeout)
+{
+    const int ret = tb_peek_event(&tb_ev, timeout);
+    if (ret > 0)
+        copy_event(ev);
+
+    return ret;
+}
+
 /* ns keys */
 }
@@ -0,0 +1,319 @@
+#include <regex>
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include <fmt/format.h>
+
+#include "library.hpp"
+#include "hash.hpp"
+#include "utils.hpp"
+
+namespace bookwyrm {
+
+/* Files we don't index: our own, and downloads that haven't finished. */
+static bool indexable(const string &name)
+{
+    const auto ends_with = [&name](const string &suffix) {
+        return name.length() >= suffix.length() &&
+            name.compare(name.length() - suffix.length(), suffix.length(), suffix) == 0;
+    };
+
+    return !name.empty() && name[0] != '.' &&
+        !ends_with(".part") && !ends_with(".journal") && !ends_with(".tmp");
+}
+
+/* Recover the key from a name on the form "authors - title (year)[.n].ext". */
+static string parse_key(const string &name)
+{
+    static const std::regex scheme(R"(^(.*) - (.*) \((-?\d+)\)(?:\.\d+)?\.([^.]+)$)");
+
+    std::smatch m;
+    if (!std::regex_match(name, m, scheme))
+        return "";
+
+    /* Anyone may name a file there; a year that doesn't fit isn't one of ours. */
+    const string digits = m[3];
+    int year;
+    if (std::from_chars(digits.data(), digits.data() + digits.size(), year).ec != std::errc())
+        return "";
+
+    return library::key_of(m[1], m[2], year, m[4]);
+}
+
+/* Empty if unreadable, or if we were stopped midway; a large file takes a while. */
+static string file_md5(const fs::path &path, const std::atomic<bool> &stop)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return "";
+
+    hash::md5 md5;
+    vector<char> buffer(1024 * 1024);
+    while (in.read(buffer.data(), buffer.size()) || in.gcount() > 0) {
+        if (stop) return "";
+        md5.update(buffer.data(), in.gcount());
+    }
+
+    return md5.hexdigest();
+}
+
+string library::key_of(const string &authors, const string &title, int year, const string &extension)
+{
+    string key = fmt::format("{} - {} ({}).{}", authors, title, year, extension);
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    return key;
+}
+
+library::library(fs::path dir)
+    : dir_(std::move(dir)), index_path_(index_path(dir_))
+{
+    load();
+
+    /* Hashing a large library takes a while; don't hold up the start, or a download. */
+    scanner_ = std::thread([this] {
+        refresh();
+        hash_pending();
+    });
+}
+
+library::~library()
+{
+    stop_ = true;
+    scanner_.join();
+}
+
+fs::path library::index_path(const fs::path &dir)
+{
+    const auto cache = utils::cache_dir();
+    if (cache.empty())
+        return {};
+
+    std::error_code ec;
+    fs::path abs = fs::canonical(dir, ec);
+    if (ec)
+        abs = fs::absolute(dir);
+
+    const string path = abs.string();
+    hash::md5 md5;
+    md5.update(path.data(), path.length());
+    return cache / "libraries" / md5.hexdigest();
+}
+
+/*
+ * The index is plain text with one file per line:
+ *
+ *   <size> <mtime> <md5> <filename>
+ *
+ * where the filename is the rest of the line.
+ */
+void library::load()
+{
+    if (index_path_.empty())
+        return;
+
+    std::ifstream in(index_path_);
+    string line;
+
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        entry e;
+
+        fields >> e.size >> e.mtime >> e.md5;
+        fields.ignore(1);
+        std::getline(fields, e.filename);
+
+        if (fields.fail() || e.filename.empty())
+            continue;
+
+        e.key = parse_key(e.filename);
+        names_.insert(e.filename);
+        entries_.emplace(e.filename, std::move(e));
+    }
+
+    reindex();
+}
+
+void library::save() const
+{
+    if (index_path_.empty())
+        return;
+
+    const fs::path tmp = fs::path(index_path_).concat(".tmp");
+
+    std::error_code ec;
+    fs::create_directories(index_path_.parent_path(), ec);
+
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        for (const auto &[name, e] : entries_) {
+            if (!e.md5.empty())
+                out << e.size << ' ' << e.mtime << ' ' << e.md5 << ' ' << name << '\n';
+        }
+    }
+
+    fs::rename(tmp, index_path_, ec);
+}
+
+void library::refresh()
+{
+    std::lock_guard<std::mutex> scanning(refresh_mutex_);
+
+    std::map<string, entry> known;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        known = entries_;
+    }
+
+    std::set<string> names;
+    std::map<string, entry> entries;
+    std::error_code ec;
+
+    for (fs::directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+        if (stop_) return;
+
+        const string name = it->path().filename().string();
+        names.insert(name);
+
+        if (!indexable(name) || !fs::is_regular_file(it->status()))
+            continue;
+
+        entry e;
+        e.filename = name;
+        e.size = fs::file_size(it->path(), ec);
+        e.mtime = fs::last_write_time(it->path(), ec).time_since_epoch().count();
+        if (ec) continue;
+
+        /* Unchanged since we last looked; no need to hash it again. */
+        if (const auto k = known.find(name); k != known.cend() &&
+                k->second.size == e.size && k->second.mtime == e.mtime) {
+            entries.emplace(name, k->second);
+            continue;
+        }
+
+        /* Hashed later, by hash_pending(). */
+        e.key = parse_key(name);
+        entries.emplace(name, std::move(e));
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+
+        for (auto &[name, e] : entries_) {
+            const auto scanned = entries.find(name);
+
+            /* Keep what was added while we scanned... */
+            if (scanned == entries.end()) {
+                if (fs::exists(dir_ / name)) {
+                    entries.emplace(name, e);
+                    names.insert(name);
+                }
+
+                continue;
+            }
+
+            /* ...and what was hashed. */
+            if (scanned->second.md5.empty() && scanned->second.size == e.size && scanned->second.mtime == e.mtime)
+                scanned->second.md5 = e.md5;
+        }
+
+        entries_ = std::move(entries);
+        names_ = std::move(names);
+        reindex();
+        save();
+    }
+
+    generation_++;
+}
+
+void library::hash_pending()
+{
+    vector<entry> pending;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        for (const auto &[name, e] : entries_) {
+            if (e.md5.empty())
+                pending.push_back(e);
+        }
+    }
+
+    if (pending.empty())
+        return;
+
+    for (auto &e : pending) {
+        e.md5 = file_md5(dir_ / e.filename, stop_);
+        if (stop_) return;
+        if (e.md5.empty()) continue;
+
+        std::lock_guard<std::mutex> guard(mutex_);
+
+        /* It may have changed, or gone, while we read it. */
+        const auto current = entries_.find(e.filename);
+        if (current == entries_.end() || current->second.size != e.size || current->second.mtime != e.mtime)
+            continue;
+
+        current->second.md5 = e.md5;
+        by_md5_.emplace(e.md5, e.filename);
+        generation_++;
+    }
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    save();
+}
+
+std::optional<library::entry> library::find(const core::item &item) const
+{
+    const string md5 = hash::md5_from_urls(item.misc.uris);
+    const string key = key_of(utils::vector_to_string(item.nonexacts.authors),
+            item.nonexacts.title, item.exacts.year, item.exacts.extension);
+
+    std::lock_guard<std::mutex> guard(mutex_);
+
+    const auto &index = md5.empty() ? by_key_ : by_md5_;
+    if (const auto name = index.find(md5.empty() ? key : md5); name != index.cend())
+        return entries_.at(name->second);
+
+    return std::nullopt;
+}
+
+void library::reindex()
+{
+    by_md5_.clear();
+    by_key_.clear();
+
+    for (const auto &[name, e] : entries_) {
+        if (!e.md5.empty()) by_md5_.emplace(e.md5, name);
+        if (!e.key.empty()) by_key_.emplace(e.key, name);
+    }
+}
+
+bool library::taken(const string &filename) const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    return names_.count(filename) > 0;
+}
+
+void library::add(const fs::path &path, const string &md5)
+{
+    entry e;
+    e.filename = path.filename().string();
+
+    std::error_code ec;
+    e.size = fs::file_size(path, ec);
+    e.mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+    if (ec) return;
+
+    e.md5 = md5;
+    e.key = parse_key(e.filename);
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    names_.insert(e.filename);
+    entries_[e.filename] = std::move(e);
+    reindex();
+    save();
+    generation_++;
+}
+
+/* ns bookwyrm */
+}
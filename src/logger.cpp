@@ -11,24 +11,32 @@ namespace logger {
 
 void bookwyrm_sink::log(const spdlog::details::log_msg &msg)
 {
-    std::lock_guard<std::mutex> guard(write_mutex_);
-
-    if (const auto &fmt = msg.formatted.str(); tui_.expired()) {
-        buffer_.emplace_back(msg.level, fmt);
-    } else if (const auto tui = tui_.lock(); tui->is_log_focused()) {
-        tui->log(msg.level, fmt);
-    } else {
-        buffer_.emplace_back(msg.level, fmt);
-
-        /* If user is in the index view, get a notice about new logs. */
-        tui->repaint_screens();
-    }
+    node *n = new node{msg.level, msg.formatted.str(), head_.load(std::memory_order_relaxed)};
+    while (!head_.compare_exchange_weak(n->next, n, std::memory_order_release, std::memory_order_relaxed));
+
+    /*
+     * Counted once it's pushed, so that it can't be marked read before it can be flushed;
+     * at worst, it's counted after being read, until the log screen is next drained.
+     */
+    unread_[msg.level]++;
+
+    /* If user is in the index view, get a notice about new logs. */
+    if (const auto tui = tui_.lock())
+        tui->update();
 }
 
 bookwyrm_sink::~bookwyrm_sink()
 {
-    for (const auto& [lvl, fmt] : buffer_)
-        (lvl <= spdlog::level::warn ? std::cout : std::cerr) << fmt;
+    for (const auto &[level, msg] : unseen_)
+        (level <= spdlog::level::warn ? std::cout : std::cerr) << msg << '\n';
+
+    for (node *n = take(); n;) {
+        (n->level <= spdlog::level::warn ? std::cout : std::cerr) << n->msg;
+
+        node *next = n->next;
+        delete n;
+        n = next;
+    }
 }
 
 void bookwyrm_sink::flush()
@@ -37,24 +45,48 @@ void bookwyrm_sink::flush()
     std::cerr << std::flush;
 }
 
-void bookwyrm_sink::flush_to_screen()
+bookwyrm_sink::node* bookwyrm_sink::take()
+{
+    node *n = head_.exchange(nullptr, std::memory_order_acquire);
+
+    /* Newest first; reverse it. */
+    node *oldest = nullptr;
+    while (n) {
+        node *next = n->next;
+        n->next = oldest;
+        oldest = n;
+        n = next;
+    }
+
+    return oldest;
+}
+
+size_t bookwyrm_sink::flush_to_screen()
 {
     const auto tui = tui_.lock();
+    if (!tui)
+        return 0;
 
-    for (const auto& [lvl, fmt] : buffer_)
-        tui->log(lvl, fmt);
+    size_t count = 0;
+    for (node *n = take(); n; count++) {
+        tui->log(n->level, std::move(n->msg));
 
-    buffer_.clear();
+        node *next = n->next;
+        delete n;
+        n = next;
+    }
+
+    return count;
 }
 
 spdlog::level::level_enum bookwyrm_sink::worst_unread() const
 {
-    const auto worst = std::max_element(cbegin(buffer_), cend(buffer_),
-        [] (const buffer_pair &a, const buffer_pair &b) {
-            return a.first < b.first;
-        });
+    for (int lvl = spdlog::level::critical; lvl > spdlog::level::trace; lvl--) {
+        if (unread_[lvl] > 0)
+            return static_cast<spdlog::level::level_enum>(lvl);
+    }
 
-    return worst->first;
+    return spdlog::level::trace;
 }
 
 /* ns logger */
@@ -1,9 +1,14 @@
+#include <optional>
+#include <algorithm>
+
 #include "core/plugin_handler.hpp"
 #include "core/item.hpp"
+#include "core/trace.hpp"
 #include "utils.hpp"
 #include "version.hpp"
 #include "command_line.hpp"
 #include "tui.hpp"
+#include "batch.hpp"
 #include "downloader.hpp"
 
 int main(int argc, char *argv[])
@@ -29,9 +34,27 @@ int main(int argc, char *argv[])
     const auto misc = cligroup("Miscellaneous")
         ("-h", "--help",       "Display this text and exit")
         ("-v", "--version",    "Print version information (" + build_info_short + ") and exit")
-        ("-D", "--debug",      "Set logging level to debug");
-
-    const cligroups groups = {main, excl, exact, misc};
+        ("-D", "--debug",      "Set logging level to debug")
+        ("-r", "--limit-rate", "Limit the combined download rate, in bytes per second. "
+                               "A suffix of k, M or G multiplies by 1024, 1024^2 or 1024^3.", "RATE")
+        ("-c", "--connections", "Open at most N connections to a single mirror "
+                               "(default: 4; 0 means no limit)", "N")
+        ("-o", "--order",      "In which order to download marked items: as marked, smallest first, "
+                               "or taking turns between mirror hosts (default: fifo)", "POLICY",
+                               valid_opts{"fifo", "smallest", "hosts"})
+        ("-l", "--log-lines",  "Keep at most N log entries in memory; older ones are appended to "
+                               "~/.cache/bookwyrm/log (default: 10000)", "N")
+        ("-T", "--trace",      "Record where the time goes, and write it to FILE as a Chrome trace "
+                               "(open it in chrome://tracing or ui.perfetto.dev)", "FILE");
+
+    const auto batch = cligroup("Batch", "for running without a terminal, e.g. from cron")
+        ("-b", "--batch",      "Don't start the TUI; download the best matches as they are found, "
+                               "and report progress as one JSON object per line on stdout")
+        ("-n", "--best",       "Download at most N items (default: 1)", "N")
+        ("-m", "--min-score",  "Only download items that match the search at least this well, "
+                               "from 0 to 100 (default: 0)", "SCORE");
+
+    const cligroups groups = {main, excl, exact, misc, batch};
 
     const auto cli = [=]() -> cliparser {
         string progname = argv[0];
@@ -60,8 +83,48 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    std::int64_t rate_limit = 0;
+    long max_host_connections = 4, log_lines = screen::log::default_capacity,
+         best = 1, min_score = 0;
+
+    /* Parse a non-negative number given to the named argument. */
+    const auto count_of = [&cli](const string &arg) -> long {
+        const auto value = cli.get(arg);
+        size_t end = 0;
+        long count = -1;
+
+        try {
+            count = std::stol(value, &end);
+        } catch (const std::exception&) {
+            end = 0;
+        }
+
+        if (end != value.length() || count < 0)
+            throw value_error("malformed value '" + value + "' for argument --" + arg);
+
+        return count;
+    };
+
     try {
         cli.validate_arguments();
+
+        if (cli.has("limit-rate"))
+            rate_limit = utils::parse_rate(cli.get("limit-rate"));
+
+        if (cli.has("connections"))
+            max_host_connections = count_of("connections");
+
+        if (cli.has("log-lines"))
+            log_lines = count_of("log-lines");
+
+        if (cli.has("best"))
+            best = count_of("best");
+
+        if (cli.has("min-score") && (min_score = count_of("min-score")) > 100)
+            throw value_error("--min-score must be at most 100");
+
+        if (cli.has("trace") && !core::trace::compiled_in)
+            throw value_error("--trace requires bookwyrm to be built with -DENABLE_TRACING=ON");
     } catch (const argument_error &err) {
         fmt::print(stderr, "error: {}; see --help\n", err.what());
         return EXIT_FAILURE;
@@ -76,8 +139,26 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    bookwyrm::downloader d(dl_path);
-    vector<core::item> wanted_items;
+    /* Declared first so that it's written last, once the downloader has stopped. */
+    std::optional<core::trace::session> trace;
+    if (cli.has("trace")) {
+        trace.emplace(cli.get("trace"));
+        core::trace::name_thread("main");
+    }
+
+    /* Plugins and downloads mostly talk to the same hosts; let them share connections. */
+    const auto share = std::make_shared<core::http_share>();
+
+    bookwyrm::downloader d(dl_path, share);
+    d.set_rate_limit(rate_limit);
+    d.set_max_host_connections(max_host_connections);
+
+    if (const auto order = cli.get("order"); order == "smallest")
+        d.set_policy(bookwyrm::queue_policy::smallest);
+    else if (order == "hosts")
+        d.set_policy(bookwyrm::queue_policy::hosts);
+
+    bool finish_downloads = false;
 
     try {
         auto logger = logger::create("main");
@@ -91,22 +172,27 @@ int main(int argc, char *argv[])
 
         const core::item wanted = utils::create_item(cli);
         auto butler = core::plugin_handler(std::move(wanted));
+        butler.set_http_share(share);
+
+        if (cli.has("batch")) {
+            const auto level = cli.has("debug") ? core::log_level::debug : core::log_level::warn;
+            auto b = bookwyrm::make_batch_with(butler, d, best, min_score, level);
+
+            return b->run() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
 
         /*
          * Find and load all worker scripts.
          * During run-time, the butler will match each found item
          * with the wanted one. If it doesn't match, it is discarded.
+         *
+         * Marked items are downloaded in the background while the TUI runs.
          */
-        auto tui = bookwyrm::make_tui_with(butler, logger);
-
-        if (tui->display()) {
-            /*
-             * Start download while plugin_handler destructs.
-             * NOTE: the TUI is blocked here; we don't want that.
-             */
-            /* d.async_download(tui->get_wanted_items()); */
-            wanted_items = tui->get_wanted_items();
-        }
+        auto tui = bookwyrm::make_tui_with(butler, logger, d, log_lines);
+
+        finish_downloads = tui->display();
+        if (!finish_downloads)
+            d.cancel_all();
 
     } catch (const component_error &err) {
         fmt::print(stderr, "A dependency failed: {}. Developer error? Terminating...\n", err.what());
@@ -116,20 +202,28 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    if (wanted_items.empty()) {
+    /* Items unmarked in the TUI were cancelled; only count what is still to come. */
+    const auto jobs = d.jobs();
+    const auto remaining = std::count_if(jobs.cbegin(), jobs.cend(), [](const auto &job) {
+        return job->state == bookwyrm::download_job::status::queued ||
+               job->state == bookwyrm::download_job::status::downloading;
+    });
+
+    if (!finish_downloads || remaining == 0) {
         /* We have nothing else to do. */
         return EXIT_SUCCESS;
     }
 
     try {
-        if (wanted_items.size() == 1)
+        /* The TUI is gone, so any remaining progress is drawn on the terminal. */
+        if (remaining == 1)
             fmt::print("Downloading item...\n");
         else
-            fmt::print("Downloading {} items...\n", wanted_items.size());
+            fmt::print("Downloading {} items...\n", remaining);
 
-        auto success = d.sync_download(wanted_items);
+        auto success = d.wait();
 
-        if (!success && wanted_items.size() > 1) {
+        if (!success && remaining > 1) {
             fmt::print("No items were successfully downloaded\n");
             return EXIT_FAILURE;
         }
@@ -0,0 +1,116 @@
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "mirror_stats.hpp"
+#include "utils.hpp"
+
+namespace bookwyrm {
+
+/* How much weight a new sample gets. */
+static constexpr double alpha = 0.3;
+
+/* What we assume of a host we know nothing about: a decent, but not great, mirror. */
+static const mirror_stats::host prior = {512 * 1024, 0.5, 0.1, 0};
+
+fs::path mirror_stats::default_path()
+{
+    if (const auto dir = utils::cache_dir(); !dir.empty())
+        return dir / "mirrors";
+
+    return {};
+}
+
+/*
+ * The file is plain text with one host per line:
+ *
+ *   <host> <throughput> <latency> <failure rate> <samples>
+ *
+ * A malformed line is skipped; these are only hints.
+ */
+mirror_stats::mirror_stats(fs::path path)
+    : path_(std::move(path))
+{
+    std::ifstream in(path_);
+    string line;
+
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        string name;
+        host h;
+
+        fields >> name >> h.throughput >> h.latency >> h.failure_rate >> h.samples;
+        if (!fields.fail())
+            hosts_[name] = h;
+    }
+}
+
+void mirror_stats::save() const
+{
+    if (path_.empty()) return;
+
+    std::error_code ec;
+    fs::create_directories(path_.parent_path(), ec);
+
+    /* Same as with journals: never leave half a file behind. */
+    const fs::path tmp = fs::path(path_).concat(".tmp");
+
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        for (const auto &[name, h] : hosts_)
+            out << name << ' ' << h.throughput << ' ' << h.latency << ' '
+                << h.failure_rate << ' ' << h.samples << '\n';
+    }
+
+    fs::rename(tmp, path_, ec);
+}
+
+mirror_stats::host& mirror_stats::sample(const string &name)
+{
+    auto &h = hosts_.try_emplace(name, prior).first->second;
+    h.samples++;
+    return h;
+}
+
+void mirror_stats::record_probe(const string &name, bool ok, double latency)
+{
+    if (name.empty()) return;
+
+    auto &h = sample(name);
+    h.failure_rate += alpha * ((ok ? 0 : 1) - h.failure_rate);
+
+    if (ok && latency >= 0)
+        h.latency += alpha * (latency - h.latency);
+}
+
+void mirror_stats::record_transfer(const string &name, bool ok, std::int64_t bytes, double seconds)
+{
+    if (name.empty()) return;
+
+    auto &h = sample(name);
+    h.failure_rate += alpha * ((ok ? 0 : 1) - h.failure_rate);
+
+    /* Too little to say anything about the throughput. */
+    if (bytes < 64 * 1024 || seconds <= 0)
+        return;
+
+    h.throughput += alpha * (bytes / seconds - h.throughput);
+}
+
+double mirror_stats::cost(const string &name, double latency) const
+{
+    constexpr double reference = 8 * 1024 * 1024;
+
+    const auto found = hosts_.find(name);
+    const host &h = found == hosts_.cend() ? prior : found->second;
+
+    const double seconds = (latency >= 0 ? latency : h.latency) +
+                           reference / std::max(h.throughput, 1.0);
+
+    /* Each failure costs us (at least) another try. */
+    return seconds / std::max(1 - h.failure_rate, 0.01);
+}
+
+/* ns bookwyrm */
+}
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <algorithm>
 
 #include <fmt/format.h>
 
@@ -45,6 +46,48 @@ void base::change_cell(int x, int y, const uint32_t ch, const colour fg, const c
     tb_change_cell(x, y, ch, static_cast<colour_t>(fg), static_cast<colour_t>(bg));
 }
 
+void base::mark_dirty(int y)
+{
+    if (y < 0 || static_cast<size_t>(y) >= get_height())
+        return;
+
+    if (dirty_rows_.size() <= static_cast<size_t>(y))
+        dirty_rows_.resize(y + 1, false);
+
+    dirty_rows_[y] = true;
+}
+
+void base::mark_dirty(int from, int to)
+{
+    from = std::max(from, 0);
+    to = std::min<int>(to, get_height());
+
+    for (int y = from; y < to; y++)
+        mark_dirty(y);
+}
+
+bool base::is_dirty(int y) const
+{
+    return all_dirty_ || (y >= 0 && static_cast<size_t>(y) < dirty_rows_.size() && dirty_rows_[y]);
+}
+
+bool base::has_damage() const
+{
+    return all_dirty_ || std::find(dirty_rows_.cbegin(), dirty_rows_.cend(), true) != dirty_rows_.cend();
+}
+
+void base::clear_row(int y)
+{
+    for (size_t x = 0; x < get_width(); x++)
+        change_cell(x, y, ' ');
+}
+
+void base::clean()
+{
+    all_dirty_ = false;
+    dirty_rows_.clear();
+}
+
 void base::init_tui()
 {
     if (screen_count_++ > 0) return;
@@ -60,40 +103,25 @@ void base::init_tui()
     tb_clear();
 }
 
-/*
- * This implementation first prints out as much as it cans and then backtracks,
- * wasting oh-so-precious CPU-cycles.
- *
- * TODO: rewrite this to only print as much as it has to.
- */
-int base::wprintlim(size_t x, const int y, const string_view &str, const size_t space, const colour attrs)
+size_t base::wprintlim(size_t x, const int y, const string_view &str, const size_t space, const colour attrs)
 {
-    const size_t limit = x + space - 1;
-    for (auto ch = str.cbegin(); ch < str.cend(); ch++) {
-        if (x == limit && str.length() > space) {
-            /* We can't fit the rest of the string. */
-
-            /* Don't print the substring's trailing whitespace. */
-            int whitespace = 0;
-            while (std::isspace(*(--ch))) {
-                x--;
-                whitespace++;
-            }
-
-            change_cell(x, y, '~', attrs);
-            return str.length() - space + whitespace;
-        }
-
-        change_cell(x++, y, *ch, attrs);
-    }
+    return wprint(x, y, utf8::fit(utf8::layout(str), space), attrs);
+}
 
-    return 0;
+size_t base::wprint(int x, const int y, const string_view &str, const colour attrs)
+{
+    return wprint(x, y, utf8::layout(str), attrs);
 }
 
-void base::wprint(int x, const int y, const string_view &str, const colour attrs)
+size_t base::wprint(int x, const int y, const utf8::text &text, const colour attrs)
 {
-    for (const uint32_t &ch : str)
-        change_cell(x++, y, ch, attrs);
+    /* Termbox skips the cell to the right of a wide character by itself. */
+    for (const auto &glyph : text.glyphs) {
+        change_cell(x, y, glyph.rune, attrs);
+        x += glyph.width;
+    }
+
+    return text.width;
 }
 
 bool base::action(const key &key, const uint32_t &ch)
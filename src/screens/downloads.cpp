@@ -0,0 +1,174 @@
+#include <fmt/format.h>
+
+#include "screens/downloads.hpp"
+#include "utils.hpp"
+
+namespace screen {
+
+downloads::downloads(bookwyrm::downloader &downloader)
+    : base(default_padding_top, default_padding_bot, default_padding_left, default_padding_right),
+    downloader_(downloader), selected_(0), scroll_offset_(0)
+{
+
+}
+
+void downloads::paint()
+{
+    const auto jobs = downloader_.jobs();
+    painted_.resize(get_height());
+
+    for (size_t y = 0; y < get_height(); y++) {
+        const size_t i = scroll_offset_ + y;
+
+        /* Only repaint the jobs that have made progress or otherwise changed. */
+        std::optional<row_t> row;
+        if (i < jobs.size()) {
+            const auto &job = *jobs[i];
+            row = row_t{job.id, job.state, job.priority, job.dlnow, job.dltotal, i == selected_};
+        }
+
+        if (row != painted_[y]) {
+            painted_[y] = row;
+            mark_dirty(y);
+        }
+
+        if (!is_dirty(y)) continue;
+
+        clear_row(y);
+        if (row)
+            print_job(y, *jobs[i], i == selected_);
+    }
+
+    clean();
+}
+
+bool downloads::action(const key &key, const uint32_t &ch)
+{
+    const auto jobs = downloader_.jobs();
+    if (selected_ < jobs.size()) {
+        switch (ch) {
+            case '+':
+                downloader_.change_priority(jobs[selected_]->id, 1);
+                return true;
+            case '-':
+                downloader_.change_priority(jobs[selected_]->id, -1);
+                return true;
+        }
+    }
+
+    return base::action(key, ch);
+}
+
+void downloads::print_job(const int y, const bookwyrm::download_job &job, bool selected)
+{
+    using status = bookwyrm::download_job::status;
+
+    const curl_off_t dlnow = job.dlnow, dltotal = job.dltotal;
+
+    /* First the state, in a fitting colour... */
+    const auto [state, attrs] = [&]() -> std::pair<string, colour> {
+        switch (job.state.load()) {
+            case status::queued:
+                return {"queued", colour::none};
+            case status::downloading:
+                if (dltotal > 0)
+                    return {fmt::format("{:>5}%", utils::ratio(dlnow, dltotal)), colour::blue};
+                return {"  ...", colour::blue};
+            case status::done:
+                return {"done", colour::green};
+            case status::failed:
+                return {"failed", colour::red};
+            case status::cancelled:
+                return {"cancel", colour::yellow};
+        }
+
+        return {"", colour::none};
+    }();
+
+    int x = 0;
+    wprint(x, y, fmt::format("[{:^6}]", state), attrs);
+    x += 9;
+
+    /* ... its priority, if the user has changed it, ... */
+    if (const int priority = job.priority; priority != 0) {
+        const string prio = fmt::format("{:+d}", priority);
+        x += wprint(x, y, prio, colour::yellow) + 1;
+    }
+
+    /* ... then how much we've got and how fast it's coming, ... */
+    if (job.state == status::downloading) {
+        const string size = fmt::format("{:.1f}/{:.1f}MB @ {:.0f}kB/s",
+                static_cast<double>(dlnow) / 1024 / 1024,
+                static_cast<double>(dltotal) / 1024 / 1024,
+                job.rate / 1024);
+        x += wprint(x, y, size) + 1;
+    } else if (job.state == status::queued && dltotal > 0) {
+        /* The mirrors have told us how large it is. */
+        const string size = fmt::format("{:.1f}MB", static_cast<double>(dltotal) / 1024 / 1024);
+        x += wprint(x, y, size) + 1;
+    }
+
+    /* ... and which item this is. */
+    const auto &item = job.item;
+    const string name = fmt::format("{} - {} ({})",
+            utils::vector_to_string(item.nonexacts.authors),
+            item.nonexacts.title, item.exacts.year);
+
+    if (static_cast<size_t>(x) < get_width())
+        wprintlim(x, y, name, get_width() - x, selected ? attribute::reverse : attribute::none);
+}
+
+string downloads::footer_info() const
+{
+    using status = bookwyrm::download_job::status;
+
+    const auto jobs = downloader_.jobs();
+    const auto count = [&jobs](status s) {
+        return std::count_if(jobs.cbegin(), jobs.cend(), [s](const auto &job) {
+            return job->state == s;
+        });
+    };
+
+    return fmt::format("Downloads: {} queued, {} downloading, {} done, {} failed.",
+            count(status::queued), count(status::downloading),
+            count(status::done), count(status::failed));
+}
+
+int downloads::scrollpercent() const
+{
+    const size_t count = downloader_.jobs().size();
+    if (count <= get_height())
+        return scroll::not_applicable;
+
+    return utils::ratio(get_height() + scroll_offset_, count);
+}
+
+void downloads::move(move_direction dir)
+{
+    const size_t count = downloader_.jobs().size();
+    if (count == 0) return;
+
+    switch (dir) {
+        case up:
+            if (selected_ > 0) selected_--;
+            break;
+        case down:
+            if (selected_ < count - 1) selected_++;
+            break;
+        case top:
+            selected_ = 0;
+            break;
+        case bot:
+            selected_ = count - 1;
+            break;
+    }
+
+    /* Keep the selected job in view. */
+    if (selected_ < scroll_offset_)
+        scroll_offset_ = selected_;
+    else if (selected_ >= scroll_offset_ + get_height())
+        scroll_offset_ = selected_ - get_height() + 1;
+}
+
+/* ns screen */
+}
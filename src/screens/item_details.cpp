@@ -3,8 +3,8 @@
 
 namespace screen {
 
-item_details::item_details(const core::item &item, int padding_top)
-    : base(padding_top, default_padding_bot, 0, 0), item_(item)
+item_details::item_details(const core::item &item, bookwyrm::enricher &enricher, int padding_top)
+    : base(padding_top, default_padding_bot, 0, 0), item_(item), enricher_(enricher)
 {
 
 }
@@ -19,8 +19,22 @@ bool item_details::action(const key &key, const uint32_t &ch)
 
 void item_details::paint()
 {
+    /* Nothing here changes once printed, but for what the enricher finds. */
+    if (auto [status, info] = enricher_.get(item_); status != status_) {
+        status_ = status;
+        info_ = std::move(info);
+        mark_all_dirty();
+    }
+
+    if (!has_damage())
+        return;
+
+    for (size_t y = 0; y < get_height(); y++)
+        clear_row(y);
+
     print_borders();
     print_details();
+    clean();
 }
 
 string item_details::footer_info() const
@@ -52,6 +66,8 @@ void item_details::print_details()
     using pair = std::pair<string, std::reference_wrapper<const string>>;
     string authors = utils::vector_to_string(item_.nonexacts.authors);
     string year = std::to_string(item_.exacts.year);
+    string pages = info_.pages > 0 ? std::to_string(info_.pages) : "";
+    string subjects = utils::vector_to_string(info_.subjects);
     const vector<pair> v = {
         {"Title",     item_.nonexacts.title},
         {"Serie",     item_.nonexacts.series},
@@ -60,6 +76,8 @@ void item_details::print_details()
         {"Publisher", item_.nonexacts.publisher},
         {"Extension", item_.exacts.extension},
         {"URI",       uris},
+        {"Pages",     pages},
+        {"Subjects",  subjects},
         // include filesize here
         // and print it red if the item is gigabytes large
     };
@@ -79,8 +97,23 @@ void item_details::print_details()
         wprint(len + 4, y++, p.second.get());
     }
 
+    using status = bookwyrm::enricher::status;
+    string desc;
+    switch (status_) {
+        case status::found:
+            desc = info_.description.empty() ? "No description found." : info_.description;
+            break;
+        case status::not_found:
+            desc = "No description found.";
+            break;
+        case status::unknown:
+        case status::pending:
+            desc = "Looking up details...";
+            break;
+    }
+
     wprint(0, ++y, "Description:", attribute::bold);
-    print_desc(++y, utils::lipsum(20));
+    print_desc(++y, desc);
 }
 
 void item_details::print_desc(int &y, string str)
@@ -89,7 +122,7 @@ void item_details::print_desc(int &y, string str)
     const auto words = utils::split_string(str);
 
     auto word_fits = [this, &x](const string &str) -> bool {
-        return static_cast<size_t>(get_width()) - x > str.length();
+        return static_cast<size_t>(get_width()) - x > utf8::width(str);
     };
 
     for (auto word = words.cbegin(); word != words.cend(); ++word) {
@@ -115,8 +148,7 @@ void item_details::print_desc(int &y, string str)
             x = 0;
         }
 
-        wprint(x, y, *word + ' ');
-        x += word->length() + 1;
+        x += wprint(x, y, *word + ' ');
     }
 }
 
@@ -3,80 +3,153 @@
 
 namespace screen {
 
-log::log()
-    : base(default_padding_top, default_padding_bot, default_padding_left, default_padding_right)
+fs::path log::default_spill_path()
+{
+    if (const auto dir = utils::cache_dir(); !dir.empty())
+        return dir / "log";
+
+    return {};
+}
+
+log::log(size_t capacity, fs::path spill)
+    : base(default_padding_top, default_padding_bot, default_padding_left, default_padding_right),
+    capacity_(std::max<size_t>(capacity, 1)), spill_path_(std::move(spill))
 {
 
 }
 
 void log::paint()
 {
-    /*
-     * Ad-hoc for now; something is wrong with entry down below.
-     * Removing this causes segfault when we have no entries.
-     */
-    if (entries_.size() == 0)
+    /* Entries wrap over several rows, so a change anywhere moves everything below it. */
+    if (!has_damage())
+        return;
+
+    for (size_t y = 0; y < get_height(); y++)
+        clear_row(y);
+    clean();
+
+    if (first_ == end_)
         return;
 
     /*
-     * Starting the counting from the latest entry,
+     * Starting the counting from the last entry we show,
      * how many entries back can we fit on screen?
      */
-    const auto start_entry = detached_at_.value_or(entries_.cend());
-    auto entry = start_entry - capacity(start_entry) - 1;
+    const size_t last = detached_at_ ? std::max(*detached_at_, first_ + 1) : end_;
+    const size_t height = get_height();
+
+    size_t n = last, rows = 0;
+    while (n > first_ && rows < height)
+        rows += lines(--n).size();
+
+    /* The topmost entry may not fit completely; then we show its last lines. */
+    int y = rows > height ? static_cast<int>(height) - static_cast<int>(rows) : 0;
+
+    for (; n < last; n++) {
+        const colour level_colour = utils::to_colour(entry(n).level);
+
+        for (const auto &line : lines(n)) {
+            if (y >= 0) {
+                int x = 0;
+                for (size_t i = 0; i < line.text.glyphs.size(); i++) {
+                    const auto &glyph = line.text.glyphs[i];
+                    change_cell(x, y, glyph.rune, i < line.coloured ? level_colour : colour::white);
+                    x += glyph.width;
+                }
+            }
 
-    int y = 0;
-    while (entry != entries_.cend()) {
-        print_entry(y, entry++);
-        y++;
+            y++;
+        }
     }
 }
 
-void log::print_entry(int &y, const entry_tp entry)
+void log::on_resize()
+{
+    /* Entries are wrapped anew when they are next painted. */
+    mark_all_dirty();
+}
+
+log::entry_t& log::entry(size_t n)
 {
-    int x = 0;
+    return ring_[n % capacity_];
+}
+
+const vector<log::line_t>& log::lines(size_t n)
+{
+    entry_t &e = entry(n);
+    const size_t width = get_width();
+
+    if (e.wrapped_width == width)
+        return e.lines;
+
+    e.lines.clear();
+    e.wrapped_width = width;
+
+    line_t line{};
+    const auto append = [&line](const utf8::text &t) {
+        line.text.glyphs.insert(line.text.glyphs.end(), t.glyphs.cbegin(), t.glyphs.cend());
+        line.text.width += t.width;
+    };
+    const auto newline = [&line, &e]() {
+        e.lines.push_back(std::move(line));
+        line = {};
+    };
+    const utf8::text space = utf8::layout(" ");
 
     /*
      * First up, split the log level from the message, and print the
      * level in a fitting colour.
      */
-    const auto [lvl, msg] = utils::split_at_first(entry->second, ":");
-    wprint(x, y, lvl, utils::to_colour(entry->first));
-    x += lvl.length();
+    const auto [lvl, msg] = utils::split_at_first(e.msg, ":");
+    append(utf8::layout(lvl));
+    line.coloured = line.text.glyphs.size();
 
     /*
      * Next up, the actual message. If the whole message doesn't fit on one line
      * we want to split it across multiple lines. But course, if one word is longer
      * than the line itself (e.g. a long path), we'll just split it where the line ends.
      */
-    for (auto word : utils::split_string(msg)) {
-        if (auto remain = get_width() - 1 - x; word.length() + 1 > remain) {
+    for (const auto &w : utils::split_string(msg)) {
+        utf8::text word = utf8::layout(w);
+
+        size_t remain = line.text.width + 1 < width ? width - 1 - line.text.width : 0;
+        if (word.width + 1 > remain) {
             /* The word doesn't fit on the rest of the line. */
 
             /* 3 is an arbitrary divisor, but we use it so that only very long words are split. */
-            if (word.length() > get_width() / 3) {
-                while (word.length() > remain) {
-                    wprint(x, y++, " " + word.substr(0, remain));
-                    word = word.substr(remain);
-                    x = 0;
-                    remain = get_width() - 1;
+            if (word.width > width / 3) {
+                while (word.width > remain) {
+                    auto [head, tail] = utf8::split(word, remain);
+                    append(space);
+                    append(head);
+                    newline();
+
+                    word = std::move(tail);
+                    remain = width - 1;
                 }
             } else {
-                ++y;
-                x = 0;
+                newline();
             }
         }
 
-        wprint(x, y, " " + word);
-        x += word.length() + 1;
+        append(space);
+        append(word);
     }
+
+    newline();
+    return e.lines;
 }
 
 string log::footer_info() const
 {
     /* stub */
-    return fmt::format("You're in the log now. Entries: {}, Attached: {}",
-            entries_.size(), !detached_at_.has_value());
+    string info = fmt::format("You're in the log now. Entries: {}, Attached: {}",
+            end_ - first_, !detached_at_.has_value());
+
+    if (first_ > 0 && !spill_path_.empty())
+        info += fmt::format(" ({} older in {})", first_, spill_path_.string());
+
+    return info;
 }
 
 int log::scrollpercent() const
@@ -84,7 +157,7 @@ int log::scrollpercent() const
     if (!detached_at_.has_value())
         return 100;
 
-    return utils::ratio(std::distance(entries_.cbegin(), *detached_at_), entries_.size());
+    return utils::ratio(std::max(*detached_at_, first_) - first_, end_ - first_);
 }
 
 void log::log_entry(spdlog::level::level_enum level, string msg)
@@ -97,37 +170,38 @@ void log::log_entry(spdlog::level::level_enum level, string msg)
      */
     std::replace(msg.begin(), msg.end(), '\n', ' ');
 
-    /*
-     * The entries_ container will after a while need to resize,
-     * this invalidates any pointers to an element within (detached_at_).
-     * So we must update that pointer here, if we indeed are detached.
-     */
-    if (detached_at_.has_value()) {
-        const auto dist = std::distance(entries_.cbegin(), detached_at_.value());
-        entries_.emplace_back(level, msg);
-        detached_at_ = entries_.cbegin() + dist;
+    if (ring_.size() < capacity_) {
+        ring_.push_back({level, std::move(msg), {}, 0});
     } else {
-        entries_.emplace_back(level, msg);
+        /* Full; make room by moving the oldest entry out to the spill file. */
+        entry_t &oldest = entry(first_++);
+        spill(oldest);
+        oldest = {level, std::move(msg), {}, 0};
     }
+
+    end_++;
+
+    /* Attached, so the new entry scrolls into view. */
+    if (!detached_at_.has_value())
+        mark_all_dirty();
 }
 
-size_t log::capacity(entry_tp entry) const
+void log::spill(const entry_t &e)
 {
-    size_t remain = get_height();
-    int capacity = 0;
-    entry--;  // We want to point at something that exists.
+    if (spill_path_.empty())
+        return;
 
-    const auto entry_height = [line_width=get_width()] (const auto e) -> size_t {
-        return std::max<size_t>(std::ceil(e->second.length() / line_width), 1);
-    };
+    if (!spill_.is_open()) {
+        std::error_code ec;
+        fs::create_directories(spill_path_.parent_path(), ec);
 
-    while (entry != entries_.cbegin() && remain > 0) {
-        remain -= entry_height(entry--);
-        if (remain > 0)
-            capacity++;
+        /* Only this run's entries; what earlier runs spilled would only grow on disk forever. */
+        spill_.open(spill_path_, std::ios::trunc);
     }
 
-    return capacity;
+    /* Nowhere to report it if this fails, least of all in the log. */
+    if (spill_)
+        spill_ << e.msg << '\n';
 }
 
 void log::toggle_action()
@@ -137,16 +211,21 @@ void log::toggle_action()
     if (detached_at_.has_value())
         detached_at_.reset();
     else
-        detached_at_ = entries_.cend();
+        detached_at_ = end_;
+
+    mark_all_dirty();
 }
 
 void log::move(move_direction dir)
 {
-    if (!detached_at_.has_value())
+    if (!detached_at_.has_value() || first_ == end_)
         return;
 
-    const bool at_first_entry = *detached_at_ == entries_.cbegin() + 1,
-               at_last_entry  = *detached_at_ == entries_.cend() - 1;
+    /* Entries may have been spilled since we detached. */
+    detached_at_ = std::max(*detached_at_, first_ + 1);
+
+    const bool at_first_entry = *detached_at_ == first_ + 1,
+               at_last_entry  = *detached_at_ + 1 >= end_;
 
     switch (dir) {
         case up:
@@ -158,12 +237,14 @@ void log::move(move_direction dir)
             (*detached_at_)++;
             break;
         case top:
-            detached_at_ = entries_.cbegin() + 1;
+            detached_at_ = first_ + 1;
             break;
         case bot:
-            detached_at_ = entries_.cend() - 1;
+            detached_at_ = end_ - 1;
             break;
     }
+
+    mark_all_dirty();
 }
 
 /* ns screen */
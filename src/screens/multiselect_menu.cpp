@@ -1,3 +1,6 @@
+#include <numeric>
+#include <algorithm>
+
 #include <fmt/format.h>
 
 #include "errors.hpp"
@@ -42,26 +45,73 @@ multiselect_menu::multiselect_menu(vector<core::item> const &items)
 
 void multiselect_menu::paint()
 {
-    for (size_t idx = 0; idx < columns_.size(); idx++) {
-        /* Can we fit another column? */
-        const size_t allowed_width = get_width() - 1 + padding_left_
-                                   - columns_[idx].startx - 2;
-        if (columns_[idx].width > allowed_width) break;
+    /* Make room for the items that have arrived since we last painted, and repaint those in view. */
+    const size_t count = item_count();
+    if (count > rows_.size()) {
+        mark_dirty(rows_.size() - scroll_offset_ + 1, count - scroll_offset_ + 1);
+        rows_.resize(count);
+    }
+
+    if (is_dirty(0)) {
+        clear_row(0);
+        print_header();
+    }
+
+    for (size_t y = 1; y <= menu_capacity(); y++) {
+        if (!is_dirty(y)) continue;
 
-        print_column(idx);
+        clear_row(y);
+        if (y + scroll_offset_ - 1 < count)
+            print_item(y);
     }
 
-    print_header();
+    clean();
+}
+
+bool multiselect_menu::action(const key &key, const uint32_t &ch)
+{
+    /* A count applies to the next command only. */
+    const size_t count = count_prefix_;
+    count_prefix_ = 0;
+
+    if (ch >= '0' && ch <= '9' && (ch != '0' || count > 0)) {
+        count_prefix_ = std::min<size_t>(count * 10 + (ch - '0'), item_count());
+        return true;
+    }
+
+    switch (ch) {
+        case 'a':
+            mark_all();
+            return true;
+        case 'c':
+            unmark_all();
+            return true;
+        case 'i':
+            invert_marks();
+            return true;
+        case 'f':
+            /* Everything in the same format as the selected item. */
+            if (item_count() == 0) return false;
+            mark_if([ext = selected_item().exacts.extension](const core::item &item) {
+                return item.exacts.extension == ext;
+            });
+            return true;
+        case 't':
+            mark_best(count > 0 ? count : 1);
+            return true;
+    }
+
+    return base::action(key, ch);
 }
 
 string multiselect_menu::footer_info() const
 {
-    return fmt::format("I've found {} items thus far.", item_count());
+    return fmt::format("I've found {} items thus far; {} marked.", item_count(), marked_items_.count());
 }
 
 string multiselect_menu::controls_legacy() const
 {
-    return "[j/k d/u]Navigation [SPACE]Toggle select [l]Open details";
+    return "[j/k d/u]Navigation [SPACE]Toggle select [a/c/i]Mark all/none/invert [f]Mark format [Nt]Mark N best [l]Open details";
 }
 
 int multiselect_menu::scrollpercent() const
@@ -74,7 +124,7 @@ int multiselect_menu::scrollpercent() const
 
 bool multiselect_menu::is_marked(const size_t idx) const
 {
-    return marked_items_.find(idx) != marked_items_.cend();
+    return marked_items_.test(idx);
 }
 
 size_t multiselect_menu::menu_capacity() const
@@ -97,6 +147,9 @@ void multiselect_menu::move(move_direction dir)
     const bool at_first_item = selected_item_ == 0,
                at_last_item  = selected_item_ == (item_count() - 1);
 
+    const size_t last_selected = selected_item_,
+                 last_scroll = scroll_offset_;
+
     switch (dir) {
         case up:
             if (at_first_item) return;
@@ -116,26 +169,121 @@ void multiselect_menu::move(move_direction dir)
             scroll_offset_ = selected_item_ - menu_capacity() + 1;
             break;
     }
+
+    if (scroll_offset_ != last_scroll) {
+        /* Every item in view has moved. */
+        mark_dirty(1, menu_capacity() + 1);
+    } else {
+        /* Only the indicator has. */
+        mark_dirty(last_selected - scroll_offset_ + 1);
+        mark_dirty(selected_item_ - scroll_offset_ + 1);
+    }
 }
 
 void multiselect_menu::mark_item(const size_t idx)
 {
-    marked_items_.insert(idx);
+    if (idx >= item_count())
+        return;
+
+    if (marked_items_.size() < item_count())
+        marked_items_.resize(item_count());
+
+    marked_items_.set(idx);
+
+    if (mark_callback_)
+        mark_callback_(idx, true);
 }
 
 void multiselect_menu::unmark_item(const size_t idx)
 {
-    marked_items_.erase(idx);
+    marked_items_.reset(idx);
+
+    if (mark_callback_)
+        mark_callback_(idx, false);
 }
 
 void multiselect_menu::toggle_action()
 {
     /* Toggle item selection. */
 
+    if (item_count() == 0)
+        return;
+
     if (is_marked(selected_item_))
         unmark_item(selected_item_);
     else
         mark_item(selected_item_);
+
+    mark_dirty(selected_item_ - scroll_offset_ + 1);
+}
+
+void multiselect_menu::bulk_mark(const std::function<void(bookwyrm::bitset&)> &op)
+{
+    marked_items_.resize(item_count());
+
+    bookwyrm::bitset marks = marked_items_;
+    op(marks);
+
+    if (bulk_mark_callback_) {
+        vector<size_t> marked, unmarked;
+        marks.for_each_change(marked_items_, [&marked, &unmarked](size_t idx, bool now_set) {
+            (now_set ? marked : unmarked).push_back(idx);
+        });
+
+        bulk_mark_callback_(marked, unmarked);
+    } else if (mark_callback_) {
+        marks.for_each_change(marked_items_, mark_callback_);
+    }
+
+    marked_items_ = std::move(marks);
+    mark_dirty(1, menu_capacity() + 1);
+}
+
+void multiselect_menu::mark_all()
+{
+    bulk_mark([](bookwyrm::bitset &marks) { marks.set_all(); });
+}
+
+void multiselect_menu::unmark_all()
+{
+    bulk_mark([](bookwyrm::bitset &marks) { marks.reset_all(); });
+}
+
+void multiselect_menu::invert_marks()
+{
+    bulk_mark([](bookwyrm::bitset &marks) { marks.flip_all(); });
+}
+
+void multiselect_menu::mark_if(const std::function<bool(const core::item&)> &pred)
+{
+    bulk_mark([this, &pred](bookwyrm::bitset &marks) {
+        for (size_t i = 0; i < marks.size(); i++) {
+            if (pred(items_[i])) marks.set(i);
+        }
+    });
+}
+
+void multiselect_menu::mark_best(size_t n)
+{
+    const size_t count = item_count();
+    n = std::min(n, count);
+    if (n == 0 || !score_) return;
+
+    /* Items don't change once found, and neither do their scores. */
+    scores_.reserve(count);
+    for (size_t i = scores_.size(); i < count; i++)
+        scores_.push_back(score_(items_[i]));
+
+    vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::nth_element(order.begin(), order.begin() + n - 1, order.end(), [this](size_t a, size_t b) {
+        return scores_[a] != scores_[b] ? scores_[a] > scores_[b] : a < b;
+    });
+
+    bulk_mark([&order, n](bookwyrm::bitset &marks) {
+        for (size_t i = 0; i < n; i++)
+            marks.set(order[i]);
+    });
 }
 
 void multiselect_menu::update_column_widths()
@@ -153,6 +301,9 @@ void multiselect_menu::update_column_widths()
         column.startx = x;
         x += column.width + 3; // We want a 1 char padding on both sides of the seperator.
     }
+
+    /* Cached rows must be truncated anew. */
+    layout_++;
 }
 
 void multiselect_menu::on_resize()
@@ -170,6 +321,8 @@ void multiselect_menu::on_resize()
      * if so, move it to menu_bot).
      */
     if (menu_at_bot()) selected_item_--;
+
+    mark_all_dirty();
 }
 
 void multiselect_menu::print_header()
@@ -186,8 +339,9 @@ void multiselect_menu::print_header()
         if (column.width > allowed_width) break;
 
         /* Center the title. */
-        wprint(x + column.width / 2  - column.title.length() / 2, 0, column.title, colour::blue | attribute::bold);
-        x += std::max(column.width, column.title.length());
+        const size_t title_width = utf8::width(column.title);
+        wprint(x + column.width / 2  - title_width / 2, 0, column.title, colour::blue | attribute::bold);
+        x += std::max(column.width, title_width);
 
         /* Padding between the title and the seperator to the left.. */
         x++;
@@ -200,42 +354,40 @@ void multiselect_menu::print_header()
     }
 }
 
-void multiselect_menu::print_column(const size_t col_idx)
+void multiselect_menu::print_item(const size_t y)
 {
-    const auto &c = columns_[col_idx];
+    const size_t i = y + scroll_offset_ - 1;
 
-    for (size_t i = scroll_offset_, y = 1; i < item_count() &&
-            y <= menu_capacity(); i++, y++) {
+    const bool on_selected_item = (i == selected_item_),
+               on_marked_item   = is_marked(i);
 
-        const bool on_selected_item = (y + scroll_offset_ == selected_item_ + 1),
-                   on_marked_item   = is_marked(y + scroll_offset_ - 1);
+    /*
+     * Print the indicator, indicating which item is
+     * currently selected.
+     */
+    if (on_selected_item && on_marked_item)
+        change_cell(0, y, rune::single::double_right_angle_bracket, attribute::reverse);
+    else if (on_selected_item)
+        change_cell(0, y, rune::single::double_right_angle_bracket);
+    else if (on_marked_item)
+        change_cell(0, y, ' ', attribute::reverse);
 
-        /*
-         * Print the indicator, indicating which item is
-         * currently selected.
-         */
-        if (on_selected_item && on_marked_item)
-            change_cell(0, y, rune::single::double_right_angle_bracket, attribute::reverse);
-        else if (on_selected_item)
-            change_cell(0, y, rune::single::double_right_angle_bracket);
-        else if (on_marked_item)
-            change_cell(0, y, ' ', attribute::reverse);
-
-        const attribute attrs = (on_selected_item || on_marked_item) ? attribute::reverse : attribute::none;
-
-        const string authors = utils::vector_to_string(items_[i].nonexacts.authors);
-        const string year = std::to_string(items_[i].exacts.year);
-        const std::array<std::reference_wrapper<const string>, 6> strings = {{
-            items_[i].nonexacts.title,
-            year,
-            items_[i].nonexacts.series,
-            authors,
-            items_[i].nonexacts.publisher,
-            items_[i].exacts.extension
-        }};
-
-        /* Print the string, check if it was truncated. */
-        const int trunc_len = wprintlim(c.startx, y, strings[col_idx].get(), c.width, attrs);
+    const attribute attrs = (on_selected_item || on_marked_item) ? attribute::reverse : attribute::none;
+
+    /* Items we already have are shown in green. */
+    const colour fg = is_owned(i) ? colour::green : colour::white;
+
+    const row_t &row = fitted_row(i);
+
+    for (size_t col_idx = 0; col_idx < columns_.size(); col_idx++) {
+        const auto &c = columns_[col_idx];
+
+        /* Can we fit another column? */
+        const size_t allowed_width = get_width() - 1 + padding_left_
+                                   - c.startx - 2;
+        if (c.width > allowed_width) break;
+
+        wprint(c.startx, y, row.fitted[col_idx], fg | attrs);
 
         /*
          * Fill the space between the two column strings with inverted spaces.
@@ -245,13 +397,59 @@ void multiselect_menu::print_column(const size_t col_idx)
          * and write until the end of the column, plus seperator and the padding on the right
          * side of it (e.g. up to and including the first char in the next column, hence the magic).
          */
-        const auto string_end = c.startx + strings[col_idx].get().length() - trunc_len,
+        const auto string_end = c.startx + row.fitted[col_idx].width,
                    next_start = c.startx + c.width + 2;
         for (auto x = string_end; x <= next_start; x++)
             change_cell(x, y, ' ', attrs);
     }
 }
 
+multiselect_menu::row_t multiselect_menu::format_row(const core::item &item)
+{
+    row_t row;
+    row.text = {{
+        utf8::layout(item.nonexacts.title),
+        utf8::layout(std::to_string(item.exacts.year)),
+        utf8::layout(item.nonexacts.series),
+        utf8::layout(utils::vector_to_string(item.nonexacts.authors)),
+        utf8::layout(item.nonexacts.publisher),
+        utf8::layout(item.exacts.extension)
+    }};
+
+    return row;
+}
+
+const multiselect_menu::row_t& multiselect_menu::fitted_row(const size_t idx)
+{
+    if (!rows_[idx])
+        rows_[idx] = std::make_unique<row_t>(format_row(items_[idx]));
+
+    row_t &row = *rows_[idx];
+    if (row.layout == layout_)
+        return row;
+
+    for (size_t col_idx = 0; col_idx < row.text.size(); col_idx++)
+        row.fitted[col_idx] = utf8::fit(row.text[col_idx], columns_[col_idx].width);
+
+    row.layout = layout_;
+    return row;
+}
+
+bool multiselect_menu::is_owned(const size_t idx)
+{
+    if (!owned_)
+        return false;
+
+    fitted_row(idx);
+    row_t &row = *rows_[idx];
+    if (row.owned_generation != owned_generation_) {
+        row.owned = owned_(items_[idx]);
+        row.owned_generation = owned_generation_;
+    }
+
+    return row.owned;
+}
+
 const std::pair<int, int> multiselect_menu::compress()
 {
     const int details_height = menu_capacity() * 0.80;
@@ -263,6 +461,7 @@ const std::pair<int, int> multiselect_menu::compress()
      */
     const int scroll = std::max<int>(selected_item_ - scroll_offset_ - menu_capacity() + 1, 0);
     scroll_offset_ += scroll;
+    mark_all_dirty();
 
     return {scroll, details_height - 1};
 }
@@ -271,6 +470,7 @@ void multiselect_menu::decompress(int scroll)
 {
     padding_bot_ = default_padding_bot;
     scroll_offset_ -= scroll;
+    mark_all_dirty();
 }
 
 } /* ns screen */
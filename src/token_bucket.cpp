@@ -0,0 +1,53 @@
+#include <thread>
+#include <algorithm>
+
+#include "token_bucket.hpp"
+
+namespace bookwyrm {
+
+token_bucket::token_bucket(std::int64_t rate)
+    : rate_(rate), tokens_(rate), last_refill_(clock::now())
+{
+}
+
+void token_bucket::set_rate(std::int64_t rate)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    rate_ = std::max<std::int64_t>(rate, 0);
+    tokens_ = rate_;
+    last_refill_ = clock::now();
+}
+
+std::int64_t token_bucket::rate() const
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    return rate_;
+}
+
+void token_bucket::refill()
+{
+    const auto now = clock::now();
+    const std::chrono::duration<double> elapsed = now - last_refill_;
+    last_refill_ = now;
+
+    tokens_ = std::min<double>(tokens_ + elapsed.count() * rate_, rate_);
+}
+
+void token_bucket::consume(std::int64_t n)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (rate_ == 0) return;
+
+    refill();
+    tokens_ -= n;
+    if (tokens_ >= 0) return;
+
+    /* Don't hold up the other transfers while we wait for our share. */
+    const std::chrono::duration<double> debt(-tokens_ / rate_);
+    lock.unlock();
+
+    std::this_thread::sleep_for(debt);
+}
+
+/* ns bookwyrm */
+}
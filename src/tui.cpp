@@ -1,19 +1,63 @@
 #include <termbox.h>
 
+#include "core/trace.hpp"
 #include "tui.hpp"
 #include "utils.hpp"
 
 namespace bookwyrm {
 
-tui::tui(vector<core::item> &items, logger_t logger)
-    : items_(items), logger_(logger), viewing_details_(false)
+tui::tui(std::function<vector<core::item>(size_t)> results_from, const core::item &wanted,
+        logger_t logger, downloader &downloader, size_t log_lines)
+    : results_from_(results_from), logger_(logger), downloader_(downloader), viewing_details_(false),
+    enricher_(downloader.http_share())
 {
-    /* Create the log screen. */
-    log_ = std::make_shared<screen::log>();
+    /* Create the log and download screens. */
+    log_ = std::make_shared<screen::log>(log_lines);
+    downloads_ = std::make_shared<screen::downloads>(downloader_);
 
     /* And create the default menu screen and focus on it. */
     index_ = std::make_shared<screen::multiselect_menu>(items_);
     focused_ = index_;
+
+    /* Start downloading an item as soon as it's marked, so browsing overlaps with the transfer. */
+    index_->set_mark_callback([this](size_t idx, bool marked) {
+        if (idx >= items_.size())
+            return;
+
+        if (marked)
+            downloader_.async_download(idx, items_[idx]);
+        else
+            downloader_.cancel(idx);
+    });
+
+    /* Marking everything shouldn't take the downloader's lock once per item. */
+    index_->set_bulk_mark_callback([this](const vector<size_t> &marked, const vector<size_t> &unmarked) {
+        downloader_.cancel(unmarked);
+        downloader_.async_download(marked, items_);
+    });
+
+    index_->set_owned_predicate([this](const core::item &item) {
+        return downloader_.local_library().owns(item);
+    });
+
+    /* Outlives us; it's the plugin handler's. */
+    index_->set_score_function([&wanted](const core::item &item) {
+        return item.score(wanted);
+    });
+
+    /* Called on the enricher's thread; the detail screen picks it up when repainted. */
+    enricher_.set_callback([this]() { update(); });
+}
+
+tui::~tui()
+{
+    /* Its line break was replaced with a space when it was logged to the screen. */
+    log_->for_each_since(log_read_, [this](spdlog::level::level_enum level, string msg) {
+        if (!msg.empty() && msg.back() == ' ')
+            msg.pop_back();
+
+        logger_->keep_unseen(level, std::move(msg));
+    });
 }
 
 void tui::log(const core::log_level level, const string message)
@@ -52,13 +96,43 @@ void tui::log(const core::log_level level, const string message)
 
 void tui::repaint_screens()
 {
-    tb_clear();
+    /*
+     * Screens only repaint the rows that have changed since they were last painted.
+     * Only when the layout changes do we clear the terminal and start over.
+     */
+    core::trace::span span("tui", "repaint");
+
+    const bool fits = bookwyrm_fits();
+    if (focused_ != painted_focus_ || fits != painted_fits_)
+        full_repaint_ = true;
+
+    /* Some items may have been downloaded and are to be shown as owned. */
+    if (const size_t gen = downloader_.local_library().generation(); gen != library_generation_) {
+        library_generation_ = gen;
+        index_->owned_changed();
+    }
+
+    if (full_repaint_) {
+        span.set_detail("full");
+        tb_clear();
 
-    if (!bookwyrm_fits()) {
+        for (const auto &screen : std::initializer_list<std::shared_ptr<screen::base>>{index_, log_, downloads_, details_}) {
+            if (screen) screen->mark_all_dirty();
+        }
+
+        full_repaint_ = false;
+        painted_focus_ = focused_;
+        painted_fits_ = fits;
+    }
+
+    if (!fits) {
         wprint(0, 0, "The terminal is too small. I don't fit!");
     } else if (is_log_focused()) {
         log_->paint();
         print_footer();
+    } else if (focused_ == downloads_) {
+        downloads_->paint();
+        print_footer();
     } else {
         index_->paint();
 
@@ -74,18 +148,18 @@ void tui::repaint_screens()
 void tui::print_footer()
 {
     const auto print_right_align = [this](int y, string &&str, const colour attrs = colour::none) {
-        this->wprint(tb_width() - str.length(), y, str, attrs);
+        this->wprint(tb_width() - utf8::width(str), y, str, attrs);
     };
 
     /* Screen info bar. */
-    wprint(0, tb_height() - 2, focused_->footer_info());
+    wprintcont(0, tb_height() - 2, focused_->footer_info());
 
     /* Scroll percentage, if any. */
     if (int perc = focused_->scrollpercent(); perc > -1)
         print_right_align(tb_height() - 2, fmt::format("({}%)", perc));
 
     /* Screen controls info bar. */
-    wprintcont(0, tb_height() - 1, "[ESC]Quit [TAB]Toggle log " + focused_->controls_legacy(),
+    wprintcont(0, tb_height() - 1, "[ESC]Quit [TAB]Toggle log [D]Downloads " + focused_->controls_legacy(),
             attribute::reverse | attribute::bold);
 
     /* Any unseen logs? */
@@ -102,45 +176,116 @@ void tui::resize_screens()
 
     /* Resizing item_details not yet supported. */
 
+    full_repaint_ = true;
     repaint_screens();
 }
 
 bool tui::display()
 {
+    using clock = std::chrono::steady_clock;
+
+    drain_messages();
     repaint_screens();
+    auto last_frame = clock::now();
+
+    const auto present = [&]() {
+        last_frame = clock::now();
+        repaint_screens();
+        frame_time_.record(clock::now() - last_frame);
+    };
 
     struct keys::event ev;
-    while (keys::poll_event(ev)) {
-        if (ev.type == type::resize) {
+    while (true) {
+        const int polled = keys::peek_event(ev, frame_budget_ms);
+        if (polled < 0)
+            throw program_error("unable to poll input");
+
+        const auto received = clock::now();
+        bool input = false;
+
+        if (polled > 0 && ev.type == type::resize) {
             close_details();
             resize_screens();
-        } else if (ev.type == type::key_press) {
-            if (ev.key == key::escape)
+        } else if (polled > 0 && ev.type == type::key_press) {
+            if (ev.key == key::escape) {
+                report_latency();
                 return false;
+            }
 
             /* When the terminal is too small, only allow quitting and window resizing. */
-            if (!bookwyrm_fits())
-                continue;
-
-            if (ev.key == key::enter)
-                return true;
+            if (bookwyrm_fits()) {
+                if (ev.key == key::enter) {
+                    report_latency();
+                    return true;
+                }
+
+                input = meta_action(ev.key, ev.ch) || focused_->action(ev.key, ev.ch);
+
+                /* The user may well open whatever is now under the cursor. */
+                if (input && focused_ == index_ && index_->item_count() > 0)
+                    enricher_.prefetch(index_->selected_item());
+            }
+        }
 
-            if (meta_action(ev.key, ev.ch) || focused_->action(ev.key, ev.ch))
-                repaint_screens();
+        /*
+         * Whatever the other threads have done is only painted once a frame,
+         * however fast it comes; input is painted right away.
+         */
+        const bool posted = drain_messages();
+        const bool frame_due = clock::now() - last_frame >= std::chrono::milliseconds(frame_budget_ms);
+
+        if (input) {
+            present();
+            input_latency_.record(clock::now() - received);
+        } else if (posted && frame_due) {
+            present();
+        } else if (posted) {
+            /* Not yet; paint it next time around. */
+            pending_update_ = true;
         }
     }
-
-    throw program_error("unable to poll input");
 }
 
-vector<core::item> tui::get_wanted_items()
+bool tui::drain_messages()
 {
-    vector<core::item> items;
+    /*
+     * Drained whether or not the log is in view, so that the sink's queue stays short and
+     * the log screen bounds what's kept. If it is in view, whatever's logged is read as it comes.
+     */
+    const bool logged = logger_->flush_to_screen() > 0;
+    if (is_log_focused())
+        mark_log_read();
+
+    /*
+     * The plugins may be adding to their results as we speak, so we paint from
+     * our own copy. Asked for after the flag is reset; what's added since asks again.
+     */
+    const bool updated = pending_update_.exchange(false);
+    if (updated) {
+        for (auto &item : results_from_(items_.size()))
+            items_.push_back(std::move(item));
+    }
+
+    return updated || logged;
+}
 
-    for (int idx : index_->marked_items())
-        items.push_back(items_[idx]);
+void tui::mark_log_read()
+{
+    log_read_ = log_->entry_count();
+    logger_->mark_read();
+}
 
-    return items;
+void tui::report_latency()
+{
+    if (input_latency_.count() == 0)
+        return;
+
+    /* These stay unread, so they're printed when we exit. */
+    logger_->debug("input latency over {} keypresses: p50 {:.2f}ms, p99 {:.2f}ms, max {:.2f}ms",
+            input_latency_.count(), input_latency_.percentile(50),
+            input_latency_.percentile(99), input_latency_.max());
+    logger_->debug("{} repaints: p50 {:.2f}ms, p99 {:.2f}ms",
+            frame_time_.count(), frame_time_.percentile(50), frame_time_.percentile(99));
 }
 
 bool tui::bookwyrm_fits()
@@ -160,11 +305,14 @@ bool tui::meta_action(const key &key, const uint32_t &ch)
             return open_details();
         case 'h':
             return close_details();
+        case 'D':
+            return toggle_downloads();
     }
 
     switch (key) {
         case key::ctrl_l:
-            /* Repaint the screens, done in calling function. */
+            /* Repaint the screens from scratch, done in calling function. */
+            full_repaint_ = true;
             return true;
         case key::arrow_right:
             return open_details();
@@ -185,7 +333,8 @@ bool tui::open_details()
     int height;
     std::tie(index_scrollback_, height) = index_->compress();
 
-    details_ = std::make_shared<screen::item_details>(index_->selected_item(), tb_height() - height - 1);
+    enricher_.request(index_->selected_item());
+    details_ = std::make_shared<screen::item_details>(index_->selected_item(), enricher_, tb_height() - height - 1);
     focused_ = details_;
 
     viewing_details_ = true;
@@ -209,10 +358,11 @@ bool tui::close_details()
 bool tui::toggle_log()
 {
     if (focused_ != log_) {
-        last_ = focused_;
+        if (focused_ != downloads_)
+            last_ = focused_;
         focused_ = log_;
 
-        logger_->flush_to_screen();
+        mark_log_read();
     } else {
         focused_ = last_;
     }
@@ -220,10 +370,28 @@ bool tui::toggle_log()
     return true;
 }
 
-void tui::wprint(int x, const int y, const string_view &str, const colour attrs)
+bool tui::toggle_downloads()
 {
-    for (const uint32_t &ch : str)
-        tb_change_cell(x++, y, ch, static_cast<colour_t>(attrs), 0);
+    if (focused_ != downloads_) {
+        if (focused_ != log_)
+            last_ = focused_;
+        focused_ = downloads_;
+    } else {
+        focused_ = last_;
+    }
+
+    return true;
+}
+
+int tui::wprint(int x, const int y, const string_view &str, const colour attrs)
+{
+    const utf8::text text = utf8::layout(str);
+    for (const auto &glyph : text.glyphs) {
+        tb_change_cell(x, y, glyph.rune, static_cast<colour_t>(attrs), 0);
+        x += glyph.width;
+    }
+
+    return x;
 }
 
 void tui::wprintcont(int x, const int y, const string_view &str, const colour attrs)
@@ -231,17 +399,18 @@ void tui::wprintcont(int x, const int y, const string_view &str, const colour at
     for (int i = 0; i < x; i++)
         tb_change_cell(i, y, ' ', static_cast<colour_t>(attrs), 0);
 
-    wprint(x, y, str, attrs);
-
-    for (int i = x + str.length(); i < tb_width(); i++)
+    for (int i = wprint(x, y, str, attrs); i < tb_width(); i++)
         tb_change_cell(i, y, ' ', static_cast<colour_t>(attrs), 0);
 }
 
-std::shared_ptr<tui> make_tui_with(core::plugin_handler &plugin_handler, logger_t &logger)
+std::shared_ptr<tui> make_tui_with(core::plugin_handler &plugin_handler, logger_t &logger,
+        downloader &downloader, size_t log_lines)
 {
     plugin_handler.load_plugins();
-    auto t = std::make_shared<tui>(plugin_handler.results(), logger);
+    auto t = std::make_shared<tui>([&plugin_handler](size_t first) { return plugin_handler.results_from(first); },
+            plugin_handler.wanted(), logger, downloader, log_lines);
     plugin_handler.set_frontend(t);
+    downloader.set_frontend(t);
     logger->set_tui(t);
     plugin_handler.async_search();
     return t;
@@ -0,0 +1,224 @@
+#include <iterator>
+#include <utility>
+#include <algorithm>
+
+#include "utf8.hpp"
+
+namespace utf8 {
+
+namespace {
+
+using range = std::pair<rune_t, rune_t>;
+
+constexpr rune_t replacement = 0xFFFD,
+                 zero_width_joiner = 0x200D;
+
+/* Combining marks, format characters and other code points that take up no cell. */
+constexpr range zero_width[] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF},
+    {0x05C1, 0x05C2}, {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A},
+    {0x064B, 0x065F}, {0x0670, 0x0670}, {0x06D6, 0x06DC}, {0x06DF, 0x06E4},
+    {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0711, 0x0711}, {0x0730, 0x074A},
+    {0x07A6, 0x07B0}, {0x0900, 0x0902}, {0x093A, 0x093A}, {0x093C, 0x093C},
+    {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963},
+    {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1160, 0x11FF},
+    {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF}, {0x200B, 0x200F}, {0x202A, 0x202E},
+    {0x2060, 0x2064}, {0x20D0, 0x20FF}, {0x302A, 0x302D}, {0x3099, 0x309A},
+    {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF}, {0x1F3FB, 0x1F3FF},
+    {0xE0001, 0xE0001}, {0xE0020, 0xE007F}, {0xE0100, 0xE01EF},
+    /* Soft hyphen, Mongolian vowel separator and the like. */
+    {0x00AD, 0x00AD}, {0x180E, 0x180E}, {0x061C, 0x061C}, {0x2028, 0x202E},
+    {0x2066, 0x206F},
+};
+
+/* East Asian Wide (W) and Fullwidth (F) code points. */
+constexpr range wide[] = {
+    {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC},
+    {0x23F0, 0x23F0}, {0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615},
+    {0x2648, 0x2653}, {0x267F, 0x267F}, {0x2693, 0x2693}, {0x26A1, 0x26A1},
+    {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5}, {0x26CE, 0x26CE},
+    {0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+    {0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B},
+    {0x2728, 0x2728}, {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755},
+    {0x2757, 0x2757}, {0x2795, 0x2797}, {0x27B0, 0x27B0}, {0x27BF, 0x27BF},
+    {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55}, {0x2E80, 0x303E},
+    {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF},
+    {0xA960, 0xA97F}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19},
+    {0xFE30, 0xFE6F}, {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4},
+    {0x17000, 0x18AFF}, {0x1B000, 0x1B2FF}, {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF},
+    {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F200, 0x1F251}, {0x1F300, 0x1F64F},
+    {0x1F680, 0x1F6FF}, {0x1F900, 0x1F9FF}, {0x1FA70, 0x1FAFF}, {0x20000, 0x3FFFD},
+};
+
+template <size_t N>
+bool in(const range (&table)[N], rune_t rune)
+{
+    return std::any_of(std::cbegin(table), std::cend(table), [rune](const range &r) {
+        return rune >= r.first && rune <= r.second;
+    });
+}
+
+bool is_control(rune_t rune)
+{
+    return rune < 0x20 || (rune >= 0x7F && rune < 0xA0);
+}
+
+/* ns anonymous */
+}
+
+rune_t decode(const string_view &str, size_t &pos)
+{
+    const auto byte = [&str](size_t i) -> rune_t {
+        return static_cast<unsigned char>(str[i]);
+    };
+
+    const rune_t lead = byte(pos);
+    if (lead < 0x80) {
+        pos++;
+        return lead;
+    }
+
+    /* How many continuation bytes, and the smallest code point that may use that many. */
+    size_t len;
+    rune_t rune, min;
+    if ((lead & 0xE0) == 0xC0) {
+        len = 1; rune = lead & 0x1F; min = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+        len = 2; rune = lead & 0x0F; min = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+        len = 3; rune = lead & 0x07; min = 0x10000;
+    } else {
+        pos++;
+        return replacement;
+    }
+
+    for (size_t i = 1; i <= len; i++) {
+        if (pos + i >= str.length() || (byte(pos + i) & 0xC0) != 0x80) {
+            pos++;
+            return replacement;
+        }
+
+        rune = (rune << 6) | (byte(pos + i) & 0x3F);
+    }
+
+    /* Overlong encodings, surrogates and what's beyond Unicode aren't characters. */
+    if (rune < min || (rune >= 0xD800 && rune <= 0xDFFF) || rune > 0x10FFFF) {
+        pos++;
+        return replacement;
+    }
+
+    pos += len + 1;
+    return rune;
+}
+
+int width(rune_t rune)
+{
+    if (rune < 0x300)
+        return rune == 0xAD ? 0 : 1;
+
+    if (in(zero_width, rune))
+        return 0;
+
+    return in(wide, rune) ? 2 : 1;
+}
+
+text layout(const string_view &str)
+{
+    text t;
+    t.glyphs.reserve(str.length());
+
+    bool joined = false;
+    for (size_t pos = 0; pos < str.length();) {
+        const rune_t rune = decode(str, pos);
+        if (is_control(rune))
+            continue;
+
+        const int w = width(rune);
+
+        /* Belongs to the previous character; a zero width joiner also glues the next one onto it. */
+        if ((w == 0 || joined) && !t.glyphs.empty()) {
+            joined = rune == zero_width_joiner;
+            continue;
+        }
+
+        joined = false;
+        if (w == 0)
+            continue;
+
+        t.glyphs.push_back({rune, static_cast<uint8_t>(w)});
+        t.width += w;
+    }
+
+    return t;
+}
+
+size_t width(const string_view &str)
+{
+    size_t w = 0;
+    bool joined = false;
+
+    for (size_t pos = 0; pos < str.length();) {
+        const rune_t rune = decode(str, pos);
+        if (is_control(rune))
+            continue;
+
+        const int rw = width(rune);
+        if ((rw == 0 || joined) && w > 0) {
+            joined = rune == zero_width_joiner;
+            continue;
+        }
+
+        joined = false;
+        w += rw;
+    }
+
+    return w;
+}
+
+text fit(const text &t, size_t cells)
+{
+    if (t.width <= cells)
+        return t;
+
+    text fitted;
+    if (cells == 0)
+        return fitted;
+
+    /* Leave room for the '~'. */
+    for (const glyph &g : t.glyphs) {
+        if (fitted.width + g.width > cells - 1)
+            break;
+
+        fitted.glyphs.push_back(g);
+        fitted.width += g.width;
+    }
+
+    /* Don't print the substring's trailing whitespace. */
+    while (!fitted.empty() && fitted.glyphs.back().rune == ' ') {
+        fitted.width -= fitted.glyphs.back().width;
+        fitted.glyphs.pop_back();
+    }
+
+    fitted.glyphs.push_back({'~', 1});
+    fitted.width++;
+    return fitted;
+}
+
+std::pair<text, text> split(const text &t, size_t cells)
+{
+    std::pair<text, text> halves;
+    auto &[head, tail] = halves;
+
+    auto g = t.glyphs.cbegin();
+    for (; g != t.glyphs.cend() && head.width + g->width <= cells; ++g) {
+        head.glyphs.push_back(*g);
+        head.width += g->width;
+    }
+
+    tail.glyphs.assign(g, t.glyphs.cend());
+    tail.width = t.width - head.width;
+    return halves;
+}
+
+/* ns utf8 */
+}
@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <cerrno>
 #include <cmath>
 
@@ -5,7 +6,7 @@
 
 namespace utils {
 
-std::error_code validate_download_dir(const fs::path &path)
+std::error_code validate_download_dir(const fs::path &path, uintmax_t needed)
 {
     constexpr auto error = [](auto ec) -> std::error_code {
         return {ec, std::generic_category()};
@@ -14,7 +15,7 @@ std::error_code validate_download_dir(const fs::path &path)
     if (!fs::exists(path))
         return error(ENOENT);
 
-    if (fs::space(path).available == 0)
+    if (fs::space(path).available < needed)
         return error(ENOSPC);
 
     if (!fs::is_directory(path))
@@ -72,6 +73,16 @@ bool readable_file(const fs::path &path)
     return fs::is_regular_file(path) && access(path.c_str(), R_OK) == 0;
 }
 
+fs::path cache_dir()
+{
+    if (const char *cache = std::getenv("XDG_CACHE_HOME"); cache && *cache)
+        return fs::path(cache) / "bookwyrm";
+    else if (const char *home = std::getenv("HOME"); home && *home)
+        return fs::path(home) / ".cache/bookwyrm";
+
+    return {};
+}
+
 /* For testing purposes. */
 string lipsum(int repeats)
 {
@@ -185,5 +196,32 @@ const core::item create_item(const cliparser &cli)
     return std::move(item);
 }
 
+std::int64_t parse_rate(const string &rate)
+{
+    size_t end = 0;
+    double value;
+
+    try {
+        value = std::stod(rate, &end);
+    } catch (const std::exception&) {
+        throw value_error("malformed rate '" + rate + '\'');
+    }
+
+    const string suffix = rate.substr(end);
+    if (suffix == "k" || suffix == "K")
+        value *= 1024;
+    else if (suffix == "m" || suffix == "M")
+        value *= 1024 * 1024;
+    else if (suffix == "g" || suffix == "G")
+        value *= 1024 * 1024 * 1024;
+    else if (!suffix.empty())
+        throw value_error("unrecognised rate suffix '" + suffix + '\'');
+
+    if (!std::isfinite(value) || value < 0)
+        throw value_error("malformed rate '" + rate + '\'');
+
+    return static_cast<std::int64_t>(value);
+}
+
 /* ns utils */
 }
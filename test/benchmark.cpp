@@ -0,0 +1,130 @@
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <unistd.h>
+#include <fmt/format.h>
+
+#include "server.hpp"
+#include "downloader.hpp"
+
+/*
+ * Measures the downloader against the test server: throughput of segmented
+ * and single-stream downloads, time to first byte, and how long it takes to
+ * fail over from a broken mirror. Exits non-zero if any item doesn't arrive
+ * intact, so that it doubles as a test.
+ */
+
+using namespace bookwyrm;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+struct mirror {
+    string name;
+    string query;
+};
+
+struct result {
+    bool ok;
+    double seconds, ttfb;
+    std::int64_t bytes;
+};
+
+/* Download an item of the given size from the given mirrors, in a fresh directory. */
+result run(test::server &server, std::int64_t size, const vector<string> &queries)
+{
+    static size_t round = 0;
+
+    const fs::path dir = fs::temp_directory_path() / fmt::format("bookwyrm-benchmark-{}-{}", getpid(), round++);
+    fs::create_directories(dir);
+
+    /* Don't let earlier rounds (or the user's own history) decide which mirror goes first. */
+    setenv("XDG_CACHE_HOME", dir.c_str(), 1);
+
+    const string md5 = test::file_spec::parse(queries.front() + fmt::format("&size={}", size)).md5();
+    vector<string> uris;
+    for (const auto &query : queries)
+        uris.push_back(server.url(fmt::format("/item?size={}&{}&md5={}", size, query, md5)));
+
+    const core::item item(std::make_tuple(
+        core::nonexacts_t({{"title", "Benchmark"}}, {"Test Server"}),
+        core::exacts_t({{"year", 2018}}, "pdf"),
+        core::misc_t(uris, {})));
+
+    result res{false, 0, -1, size};
+    {
+        downloader d(dir.string(), std::make_shared<core::http_share>());
+
+        const auto start = clock_type::now();
+        d.async_download(0, item);
+
+        /* Poll for the first byte while we wait. */
+        std::thread poll([&]() {
+            while (true) {
+                const auto job = d.jobs().front();
+                if (res.ttfb < 0 && job->dlnow > 0)
+                    res.ttfb = std::chrono::duration<double>(clock_type::now() - start).count();
+
+                const auto state = job->state.load();
+                if (state != download_job::status::queued && state != download_job::status::downloading)
+                    return;
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+
+        d.wait();
+        poll.join();
+        res.seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+        const auto job = d.jobs().front();
+        res.ok = job->state == download_job::status::done && job->md5 == md5;
+    }
+
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    return res;
+}
+
+/* ns anonymous */
+}
+
+int main()
+{
+    /* The downloader would draw its progress bar otherwise. */
+    std::cout.setstate(std::ios::failbit);
+
+    test::server server;
+    server.start();
+
+    constexpr std::int64_t MiB = 1024 * 1024;
+
+    const struct {
+        string name;
+        std::int64_t size;
+        vector<string> mirrors;
+    } benchmarks[] = {
+        {"segmented, one mirror",          64 * MiB, {"ranges=1"}},
+        {"segmented, two 4MiB/s mirrors",  32 * MiB, {"ranges=1&rate=4194304", "ranges=1&rate=4194304"}},
+        {"single stream",                  64 * MiB, {"ranges=0"}},
+        {"single stream, 200ms latency",    1 * MiB, {"ranges=0&latency=200"}},
+        {"failover: connection dropped",   16 * MiB, {"ranges=0&fail_after=1048576", "ranges=0"}},
+        {"failover: captcha page",         16 * MiB, {"ranges=0&html=1", "ranges=0"}},
+        {"failover: HTTP 500",             16 * MiB, {"ranges=0&status=500", "ranges=0"}},
+        {"failover: segment dropped",      64 * MiB, {"ranges=1&fail_after=1048576", "ranges=1"}},
+    };
+
+    int failures = 0;
+    fmt::print(stderr, "{:<32} {:>8} {:>10} {:>9}\n", "benchmark", "time", "rate", "ttfb");
+
+    for (const auto &b : benchmarks) {
+        const result r = run(server, b.size, b.mirrors);
+        failures += !r.ok;
+
+        fmt::print(stderr, "{:<32} {:>7.3f}s {:>6.1f}MB/s {:>8.1f}ms{}\n", b.name, r.seconds,
+                r.bytes / r.seconds / MiB, r.ttfb * 1000, r.ok ? "" : "  FAILED");
+    }
+
+    fmt::print(stderr, "{} requests served\n", server.requests());
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
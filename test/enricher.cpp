@@ -0,0 +1,146 @@
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <cstdlib>
+#include <unistd.h>
+#include <fmt/format.h>
+
+#include "server.hpp"
+#include "enricher.hpp"
+
+/*
+ * Looks items up in canned Open Library answers served by the test server:
+ * by ISBN (edition, then work), by title (search), a miss, and then again,
+ * the miss included, from the on-disk cache with the server gone.
+ */
+
+using namespace bookwyrm;
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const string &what)
+{
+    if (!ok) failures++;
+    fmt::print(stderr, "{:<48} {}\n", what, ok ? "ok" : "FAILED");
+}
+
+void write(const fs::path &path, const string &contents)
+{
+    fs::create_directories(path.parent_path());
+    std::ofstream(path) << contents;
+}
+
+core::item make_item(const string &title, const vector<string> &isbns)
+{
+    return core::item(std::make_tuple(
+        core::nonexacts_t({{"title", title}}, {"Test Author"}),
+        core::exacts_t({{"year", 2018}}, "pdf"),
+        core::misc_t({}, isbns)));
+}
+
+/* Wait for the lookup to finish, or give up after a while. */
+std::pair<enricher::status, item_info> await(enricher &e, const core::item &item)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+    while (std::chrono::steady_clock::now() < deadline) {
+        const auto result = e.get(item);
+        if (result.first != enricher::status::pending)
+            return result;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    return e.get(item);
+}
+
+/* ns anonymous */
+}
+
+int main()
+{
+    const fs::path dir = fs::temp_directory_path() / fmt::format("bookwyrm-enricher-{}", getpid());
+    const fs::path root = dir / "root", cache = dir / "cache";
+
+    write(root / "isbn" / "9780261103252.json", R"({
+        "title": "The Lord of the Rings",
+        "number_of_pages": 1216,
+        "subjects": ["Fantasy", {"name": "Middle Earth"}],
+        "works": [{"key": "/works/OL1W"}]
+    })");
+    write(root / "isbn" / "1111111111.json", R"({
+        "title": "Too Long",
+        "number_of_pages": 1e300,
+        "works": [{"key": "/works/OL1W"}]
+    })");
+    write(root / "works" / "OL1W.json", R"({
+        "description": {"type": "/type/text", "value": "One ring to rule them all."}
+    })");
+    write(root / "search.json", R"({
+        "numFound": 1,
+        "docs": [{"key": "/works/OL1W", "subject": ["Hobbits"], "number_of_pages_median": 310}]
+    })");
+
+    const core::item by_isbn = make_item("The Lord of the Rings", {"978-0-261-10325-2"}),
+                     by_title = make_item("The Hobbit", {}),
+                     missing = make_item("Nowhere", {"0000000000"}),
+                     too_long = make_item("Too Long", {"1111111111"});
+
+    {
+        test::server server(0, root);
+        server.start();
+
+        enricher e(std::make_shared<core::http_share>(), server.url(""), cache);
+
+        check(enricher::key_of(by_isbn) == "isbn:9780261103252", "key by ISBN");
+        check(enricher::key_of(by_title) == "title:the hobbit", "key by title");
+
+        e.request(by_isbn);
+        const auto [st, info] = await(e, by_isbn);
+        check(st == enricher::status::found, "found by ISBN");
+        check(info.description == "One ring to rule them all.", "description from the work");
+        check(info.pages == 1216, "pages from the edition");
+        check(info.subjects == vector<string>({"Fantasy", "Middle Earth"}), "subjects from the edition");
+
+        e.prefetch(by_title);
+        const auto [title_st, title_info] = await(e, by_title);
+        check(title_st == enricher::status::found, "found by title");
+        check(title_info.pages == 310 && title_info.subjects == vector<string>({"Hobbits"}), "details from the search");
+
+        e.request(missing);
+        check(await(e, missing).first == enricher::status::not_found, "missing ISBN not found");
+
+        e.request(too_long);
+        check(await(e, too_long).second.pages == 0, "no page count beyond an int");
+
+        /* Looked up once; asking again is answered from memory. */
+        const size_t served = server.requests();
+        e.request(by_isbn);
+        check(e.get(by_isbn).first == enricher::status::found && server.requests() == served, "cached in memory");
+    }
+
+    check(fs::exists(cache) && !fs::is_empty(cache), "cached on disk");
+
+    {
+        /* Nothing listens there now; what we get must come from the disk. */
+        enricher e(nullptr, "http://127.0.0.1:1", cache);
+
+        e.request(by_isbn);
+        const auto [st, info] = await(e, by_isbn);
+        check(st == enricher::status::found && info.description == "One ring to rule them all.", "found on disk");
+
+        e.request(missing);
+        check(await(e, missing).first == enricher::status::not_found, "miss cached on disk");
+
+        /* Unreachable, which isn't remembered as a miss. */
+        const core::item unknown = make_item("Unknown", {});
+        e.request(unknown);
+        check(await(e, unknown).first == enricher::status::unknown, "network error not cached");
+    }
+
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,107 @@
+#include "offscreen.hpp"
+
+namespace bookwyrm::test::offscreen {
+
+namespace {
+
+int width_ = 80, height_ = 24;
+vector<tb_cell> cells_(width_ * height_);
+size_t changes_ = 0;
+
+/* ns anonymous */
+}
+
+void resize(int width, int height)
+{
+    width_ = width;
+    height_ = height;
+    cells_.assign(width * height, tb_cell{' ', TB_DEFAULT, TB_DEFAULT});
+}
+
+const tb_cell& cell(int x, int y)
+{
+    return cells_[y * width_ + x];
+}
+
+string row(int y)
+{
+    string text;
+    for (int x = 0; x < width_; x++) {
+        const uint32_t ch = cell(x, y).ch;
+        text += ch < 0x80 ? static_cast<char>(ch) : '?';
+    }
+
+    return text;
+}
+
+size_t take_changes()
+{
+    const size_t changes = changes_;
+    changes_ = 0;
+    return changes;
+}
+
+/* ns bookwyrm::test::offscreen */
+}
+
+using namespace bookwyrm::test;
+
+/* What of termbox the screens use. */
+extern "C" {
+
+int tb_init(void)
+{
+    return 0;
+}
+
+void tb_shutdown(void) {}
+
+int tb_width(void)
+{
+    return offscreen::width_;
+}
+
+int tb_height(void)
+{
+    return offscreen::height_;
+}
+
+void tb_clear(void)
+{
+    offscreen::resize(offscreen::width_, offscreen::height_);
+}
+
+void tb_present(void) {}
+
+void tb_set_cursor(int, int) {}
+
+int tb_select_output_mode(int mode)
+{
+    return mode;
+}
+
+void tb_change_cell(int x, int y, uint32_t ch, uint16_t fg, uint16_t bg)
+{
+    if (x < 0 || y < 0 || x >= offscreen::width_ || y >= offscreen::height_)
+        return;
+
+    offscreen::cells_[y * offscreen::width_ + x] = {ch, fg, bg};
+    offscreen::changes_++;
+}
+
+struct tb_cell* tb_cell_buffer(void)
+{
+    return offscreen::cells_.data();
+}
+
+int tb_peek_event(struct tb_event*, int)
+{
+    return 0;
+}
+
+int tb_poll_event(struct tb_event*)
+{
+    return -1;
+}
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <termbox.h>
+
+#include "common.hpp"
+
+/*
+ * Stands in for termbox when linked instead of it: the screens draw into
+ * a cell buffer in memory, of whatever size we say the terminal is.
+ * Nothing is read from or written to an actual terminal.
+ */
+namespace bookwyrm::test::offscreen {
+
+/* Resize the "terminal"; the buffer is cleared. */
+void resize(int width, int height);
+
+const tb_cell& cell(int x, int y);
+
+/* Row y as text, one character per cell. */
+string row(int y);
+
+/* How many cells have been changed since the last call. */
+size_t take_changes();
+
+/* ns bookwyrm::test::offscreen */
+}
@@ -0,0 +1,227 @@
+#include <chrono>
+#include <cstdlib>
+#include <fmt/format.h>
+
+#include "offscreen.hpp"
+#include "enricher.hpp"
+#include "screens/log.hpp"
+#include "screens/item_details.hpp"
+#include "screens/multiselect_menu.hpp"
+
+/*
+ * Measures how long the screens take to paint, scroll and resize, drawing
+ * into an offscreen cell buffer instead of a terminal, for result sets and
+ * logs of 1k, 100k and 1M rows (or the sizes given as arguments). Exits
+ * non-zero if what's painted isn't what should be, so that it doubles as
+ * a test.
+ */
+
+using namespace bookwyrm;
+using clock_type = std::chrono::steady_clock;
+
+namespace {
+
+constexpr int width = 160, height = 50;
+
+int failures = 0;
+
+void check(bool ok, const string &what)
+{
+    if (ok) return;
+
+    failures++;
+    fmt::print(stderr, "FAILED: {}\n", what);
+}
+
+/* Mean milliseconds per call of f, over n calls. */
+template <typename F>
+double per_call(size_t n, F f)
+{
+    const auto start = clock_type::now();
+    for (size_t i = 0; i < n; i++)
+        f(i);
+
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start).count() / n;
+}
+
+void report(const string &screen, size_t rows, const string &what, double ms)
+{
+    fmt::print(stderr, "{:<14} {:>8} {:<24} {:>10.4f}ms\n", screen, rows, what, ms);
+}
+
+vector<core::item> make_items(size_t n)
+{
+    static const vector<string> titles = {
+        "The Art of Computer Programming", "Structure and Interpretation of Computer Programs",
+        "Война и мир", "吾輩は猫である", "Gödel, Escher, Bach: an Eternal Golden Braid",
+    };
+
+    vector<core::item> items;
+    items.reserve(n);
+
+    for (size_t i = 0; i < n; i++) {
+        items.emplace_back(std::make_tuple(
+            core::nonexacts_t({
+                {"title", fmt::format("{}, volume {}", titles[i % titles.size()], i)},
+                {"series", i % 3 ? "" : "Classics"},
+                {"publisher", "Test Press"}
+            }, {"An Author", fmt::format("Author {}", i % 97)}),
+            core::exacts_t({{"year", static_cast<int>(1900 + i % 120)}}, i % 2 ? "pdf" : "epub"),
+            core::misc_t({fmt::format("http://127.0.0.1/item?size={}", i)}, {})));
+    }
+
+    return items;
+}
+
+/* Nothing found yet; toggling, as the user may well try, must do nothing. */
+void check_empty_menu()
+{
+    const vector<core::item> none;
+    screen::multiselect_menu menu(none);
+    menu.on_resize();
+
+    menu.toggle_action();
+    menu.paint();
+    check(menu.marked_items().none(), "menu: toggling an empty menu marks nothing");
+}
+
+void bench_menu(size_t n)
+{
+    const vector<core::item> items = make_items(n);
+    screen::multiselect_menu menu(items);
+    menu.on_resize();
+
+    /* Everything is formatted on the first paint; then only what has changed is painted. */
+    report("menu", n, "first paint", per_call(1, [&](size_t) { menu.paint(); }));
+    check(test::offscreen::row(1).find("volume 0") != string::npos, "menu: first item painted");
+
+    test::offscreen::take_changes();
+    report("menu", n, "repaint, nothing new", per_call(1000, [&](size_t) { menu.paint(); }));
+    check(test::offscreen::take_changes() == 0, "menu: nothing repainted when nothing changed");
+
+    /* The rows the selection left and entered, each cleared and printed anew. */
+    menu.move(screen::base::down);
+    menu.paint();
+    const size_t changed = test::offscreen::take_changes();
+    check(changed > 0 && changed <= 4 * width, "menu: moving the selection repaints two rows");
+
+    report("menu", n, "scroll a row", per_call(1000, [&](size_t) {
+        menu.move(screen::base::down);
+        menu.paint();
+    }));
+
+    report("menu", n, "scroll to top/bottom", per_call(100, [&](size_t i) {
+        menu.move(i % 2 ? screen::base::top : screen::base::bot);
+        menu.paint();
+    }));
+    check(test::offscreen::row(1).find("volume 0") != string::npos, "menu: back at the top");
+
+    report("menu", n, "mark all, invert", per_call(10, [&](size_t) {
+        menu.mark_all();
+        menu.invert_marks();
+        menu.paint();
+    }));
+
+    report("menu", n, "resize", per_call(100, [&](size_t i) {
+        test::offscreen::resize(i % 2 ? width : width / 2, height);
+        menu.on_resize();
+        menu.paint();
+    }));
+}
+
+void bench_log(size_t n)
+{
+    screen::log log(n, "");
+    log.on_resize();
+
+    report("log", n, "append", per_call(n, [&](size_t i) {
+        log.log_entry(i % 7 ? spdlog::level::info : spdlog::level::warn,
+                fmt::format("info: entry {} of a log that goes on and on about something or other "
+                            "for long enough that it must wrap around to the next row", i));
+    }));
+
+    report("log", n, "paint", per_call(1, [&](size_t) { log.paint(); }));
+
+    test::offscreen::take_changes();
+    log.paint();
+    check(test::offscreen::take_changes() == 0, "log: nothing repainted when nothing changed");
+    check(test::offscreen::row(height - screen::default_padding_bot - 1).find(fmt::format("{}", n - 1)) != string::npos ||
+          test::offscreen::row(height - screen::default_padding_bot - 2).find(fmt::format("{}", n - 1)) != string::npos,
+          "log: last entry painted");
+
+    report("log", n, "append and paint", per_call(1000, [&](size_t i) {
+        log.log_entry(spdlog::level::info, fmt::format("info: one more, {}", i));
+        log.paint();
+    }));
+
+    /* Detach, and scroll back through the log. */
+    log.toggle_action();
+    report("log", n, "scroll an entry", per_call(1000, [&](size_t) {
+        log.move(screen::base::up);
+        log.paint();
+    }));
+
+    report("log", n, "scroll to top/bottom", per_call(100, [&](size_t i) {
+        log.move(i % 2 ? screen::base::top : screen::base::bot);
+        log.paint();
+    }));
+
+    /* Entries are wrapped anew for the new width as they come into view. */
+    report("log", n, "resize", per_call(100, [&](size_t i) {
+        test::offscreen::resize(i % 2 ? width : width / 2, height);
+        log.on_resize();
+        log.paint();
+    }));
+}
+
+void bench_details(size_t n)
+{
+    const vector<core::item> items = make_items(std::min<size_t>(n, 1000));
+
+    /* Nowhere to look anything up; it's only the painting we're after. */
+    enricher e(nullptr, "http://127.0.0.1:1", "");
+
+    screen::item_details details(items.back(), e, height / 5);
+
+    report("item_details", n, "first paint", per_call(1, [&](size_t) { details.paint(); }));
+    test::offscreen::take_changes();
+    report("item_details", n, "repaint, nothing new", per_call(1000, [&](size_t) { details.paint(); }));
+    check(test::offscreen::take_changes() == 0, "item_details: nothing repainted when nothing changed");
+
+    report("item_details", n, "resize", per_call(100, [&](size_t i) {
+        test::offscreen::resize(i % 2 ? width : width / 2, height);
+        details.mark_all_dirty();
+        details.paint();
+    }));
+}
+
+/* ns anonymous */
+}
+
+int main(int argc, char *argv[])
+{
+    vector<size_t> sizes;
+    for (int i = 1; i < argc; i++)
+        sizes.push_back(std::stoul(argv[i]));
+
+    if (sizes.empty())
+        sizes = {1000, 100000, 1000000};
+
+    fmt::print(stderr, "{:<14} {:>8} {:<24} {:>12}\n", "screen", "rows", "benchmark", "time");
+
+    test::offscreen::resize(width, height);
+    check_empty_menu();
+
+    for (const size_t n : sizes) {
+        test::offscreen::resize(width, height);
+        bench_menu(n);
+
+        test::offscreen::resize(width, height);
+        bench_log(n);
+
+        test::offscreen::resize(width, height);
+        bench_details(n);
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
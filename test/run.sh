@@ -1,16 +1,13 @@
 #! /usr/bin/env sh
-# Start a simple HTTP server from which bookwyrm fetches from in DEBUG build
+# Start the test server from which bookwyrm fetches from in DEBUG build
+# (configure with -DBUILD_TESTS=ON)
 
 PORT=8000
 
-# Kill anything occupying port port the port
-kill $(lsof -i tcp:$PORT | awk 'FNR==2{ print $2 }')
-
 top="$(git rev-parse --show-toplevel)"
 
 # Start the server in the background
-cd "$top/test"
-python3 -m http.server $PORT 2>&1 > http.output &
+"$top/build/test/test-server" $PORT "$top/test" > "$top/test/http.output" 2>&1 &
 serverpid=$!
 
 cd "$top/build"
@@ -21,4 +18,3 @@ else
 fi
 
 kill $serverpid
-
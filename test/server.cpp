@@ -0,0 +1,344 @@
+#include <map>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <fmt/format.h>
+
+#include "server.hpp"
+#include "hash.hpp"
+
+namespace bookwyrm::test {
+
+file_spec file_spec::parse(const string &query)
+{
+    file_spec spec;
+    std::istringstream pairs(query);
+    string pair;
+
+    while (std::getline(pairs, pair, '&')) {
+        const auto eq = pair.find('=');
+        const string key = pair.substr(0, eq),
+                     value = eq == string::npos ? "" : pair.substr(eq + 1);
+
+        if (key == "size")
+            spec.size = std::stoll(value);
+        else if (key == "rate")
+            spec.rate = std::stoll(value);
+        else if (key == "latency")
+            spec.latency = std::stoi(value);
+        else if (key == "ranges")
+            spec.ranges = value != "0";
+        else if (key == "status")
+            spec.status = std::stoi(value);
+        else if (key == "fail_after")
+            spec.fail_after = std::stoll(value);
+        else if (key == "html")
+            spec.html = value != "0";
+        else if (key == "kind")
+            spec.kind = value;
+
+        /* Anything else (e.g. md5=) is for the client. */
+    }
+
+    return spec;
+}
+
+void file_spec::fill(std::int64_t offset, char *buf, size_t len) const
+{
+    static const std::map<string, string> magic = {
+        {"pdf",  "%PDF-1.4\n"},
+        {"epub", string("PK\x03\x04", 4)},
+        {"djvu", "AT&TFORM"},
+    };
+
+    const auto m = magic.find(kind);
+    const string &head = m == magic.cend() ? "" : m->second;
+
+    for (size_t i = 0; i < len; i++) {
+        const std::uint64_t pos = offset + i;
+        buf[i] = pos < head.size() ? head[pos] : static_cast<char>((pos * 2654435761u) >> 13);
+    }
+}
+
+string file_spec::md5() const
+{
+    hash::md5 digest;
+    vector<char> buf(1024 * 1024);
+
+    for (std::int64_t offset = 0; offset < size; offset += buf.size()) {
+        const size_t len = std::min<std::int64_t>(buf.size(), size - offset);
+        fill(offset, buf.data(), len);
+        digest.update(buf.data(), len);
+    }
+
+    return digest.hexdigest();
+}
+
+server::server(uint16_t port, fs::path root)
+    : root_(std::move(root))
+{
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0)
+        throw std::runtime_error(fmt::format("socket: {}", std::strerror(errno)));
+
+    const int yes = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd_, 64) < 0) {
+        close(listen_fd_);
+        throw std::runtime_error(fmt::format("unable to listen on port {}: {}", port, std::strerror(errno)));
+    }
+
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+}
+
+server::~server()
+{
+    stop();
+    close(listen_fd_);
+}
+
+string server::url(const string &path) const
+{
+    return fmt::format("http://127.0.0.1:{}{}", port_, path);
+}
+
+void server::start()
+{
+    acceptor_ = std::thread(&server::run, this);
+}
+
+void server::stop()
+{
+    if (stop_.exchange(true))
+        return;
+
+    /* Wakes up accept() and every recv(). */
+    shutdown(listen_fd_, SHUT_RDWR);
+    {
+        std::lock_guard<std::mutex> guard(clients_mutex_);
+        for (int fd : clients_)
+            shutdown(fd, SHUT_RDWR);
+    }
+
+    if (acceptor_.joinable())
+        acceptor_.join();
+
+    for (auto &worker : workers_)
+        worker.join();
+}
+
+void server::run()
+{
+    while (!stop_) {
+        const int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        const int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        std::lock_guard<std::mutex> guard(clients_mutex_);
+        if (stop_) {
+            close(fd);
+            break;
+        }
+
+        clients_.insert(fd);
+        workers_.emplace_back(&server::serve, this, fd);
+    }
+}
+
+void server::serve(int fd)
+{
+    string buffer;
+    char chunk[4096];
+
+    while (!stop_) {
+        /* Requests have no body, so they end with an empty line. */
+        const auto end = buffer.find("\r\n\r\n");
+        if (end == string::npos) {
+            const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) break;
+
+            buffer.append(chunk, n);
+            continue;
+        }
+
+        const string request = buffer.substr(0, end + 2);
+        buffer.erase(0, end + 4);
+        requests_++;
+
+        if (!respond(fd, request))
+            break;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(clients_mutex_);
+        clients_.erase(fd);
+    }
+
+    close(fd);
+}
+
+bool server::send_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        const ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+bool server::respond(int fd, const string &request)
+{
+    std::istringstream lines(request);
+    string method, target, version;
+    lines >> method >> target >> version;
+
+    std::int64_t range_start = -1, range_end = -1;
+    bool keep_alive = true;
+
+    string line;
+    std::getline(lines, line);
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        string lower = line;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+        if (lower.compare(0, 13, "range: bytes=") == 0) {
+            const string spec = line.substr(13);
+            const auto dash = spec.find('-');
+            range_start = std::stoll(spec.substr(0, dash));
+            range_end = dash + 1 < spec.size() ? std::stoll(spec.substr(dash + 1)) : -1;
+        } else if (lower == "connection: close") {
+            keep_alive = false;
+        }
+    }
+
+    const bool head_only = method == "HEAD";
+    const auto query_at = target.find('?');
+    const string path = target.substr(0, query_at),
+                 query = query_at == string::npos ? "" : target.substr(query_at + 1);
+
+    const auto reply = [&](int status, const string &reason, const string &headers, const string &body) {
+        const string response = fmt::format("HTTP/1.1 {} {}\r\n{}Content-Length: {}\r\n\r\n",
+                status, reason, headers, body.size());
+        return send_all(fd, response.data(), response.size()) &&
+            (head_only || send_all(fd, body.data(), body.size())) && keep_alive;
+    };
+
+    /*
+     * A real file, for the test plugin's sake; or a canned API answer, in which
+     * case the query is whatever the client asked and is ignored.
+     */
+    const fs::path file = root_.empty() || path.find("..") != string::npos ?
+        fs::path() : root_ / fs::path(path).relative_path();
+    if ((query_at == string::npos && path != "/big") || (!file.empty() && fs::is_regular_file(file))) {
+        std::ifstream in(file, std::ios::binary);
+        if (file.empty() || !fs::is_regular_file(file) || !in)
+            return reply(404, "Not Found", "Content-Type: text/html\r\n", "<html><body>404</body></html>");
+
+        const string type = file.extension() == ".json" ? "application/json" : "application/octet-stream";
+        std::ostringstream body;
+        body << in.rdbuf();
+        return reply(200, "OK", "Content-Type: " + type + "\r\n", body.str());
+    }
+
+    const file_spec spec = file_spec::parse(query);
+
+    if (spec.latency > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(spec.latency));
+
+    if (spec.status != 200)
+        return reply(spec.status, "Error", "Content-Type: text/html\r\n", "<html><body>error</body></html>");
+
+    if (spec.html) {
+        return reply(200, "OK", "Content-Type: text/html; charset=utf-8\r\n",
+                "<html><head><title>Are you a robot?</title></head><body>captcha</body></html>");
+    }
+
+    /* Which part of the file do we send? */
+    std::int64_t first = 0, last = spec.size - 1;
+    bool partial = false;
+    if (spec.ranges && range_start >= 0) {
+        if (range_start >= spec.size)
+            return reply(416, "Range Not Satisfiable", fmt::format("Content-Range: bytes */{}\r\n", spec.size), "");
+
+        first = range_start;
+        last = range_end < 0 ? spec.size - 1 : std::min(range_end, spec.size - 1);
+        partial = true;
+    }
+
+    const string content_type = spec.kind == "pdf" ? "application/pdf" : "application/octet-stream";
+    string headers = fmt::format("HTTP/1.1 {}\r\nContent-Type: {}\r\nContent-Length: {}\r\nETag: \"{}-{}\"\r\n",
+            partial ? "206 Partial Content" : "200 OK", content_type, last - first + 1, spec.size, spec.kind);
+    if (spec.ranges)
+        headers += "Accept-Ranges: bytes\r\n";
+    if (partial)
+        headers += fmt::format("Content-Range: bytes {}-{}/{}\r\n", first, last, spec.size);
+    headers += "\r\n";
+
+    if (!send_all(fd, headers.data(), headers.size()))
+        return false;
+
+    if (head_only)
+        return keep_alive;
+
+    /* Send the body in chunks, sleeping as needed to keep to the rate. */
+    const auto started = std::chrono::steady_clock::now();
+    vector<char> chunk(16 * 1024);
+    std::int64_t sent = 0;
+
+    for (std::int64_t offset = first; offset <= last && !stop_;) {
+        size_t len = std::min<std::int64_t>(chunk.size(), last - offset + 1);
+        if (spec.fail_after >= 0 && sent + static_cast<std::int64_t>(len) > spec.fail_after) {
+            len = spec.fail_after - sent;
+            spec.fill(offset, chunk.data(), len);
+            send_all(fd, chunk.data(), len);
+            return false;
+        }
+
+        spec.fill(offset, chunk.data(), len);
+        if (!send_all(fd, chunk.data(), len))
+            return false;
+
+        offset += len;
+        sent += len;
+
+        if (spec.rate > 0) {
+            const auto due = started + std::chrono::duration<double>(static_cast<double>(sent) / spec.rate);
+            std::this_thread::sleep_until(due);
+        }
+    }
+
+    return keep_alive && !stop_;
+}
+
+/* ns bookwyrm::test */
+}
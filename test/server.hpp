@@ -0,0 +1,114 @@
+#pragma once
+
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <experimental/filesystem>
+
+#include "common.hpp"
+
+namespace fs = std::experimental::filesystem;
+
+namespace bookwyrm::test {
+
+/*
+ * How a synthetic file is served. Set through the query string, e.g.
+ *
+ *   /anything?size=67108864&rate=1048576&latency=200&ranges=0
+ *
+ * so that each mirror of a test item can misbehave in its own way.
+ */
+struct file_spec {
+    std::int64_t size = 64 * 1024 * 1024;
+
+    /* Bytes per second and connection; 0 is unlimited. */
+    std::int64_t rate = 0;
+
+    /* Milliseconds before the response headers are sent. */
+    int latency = 0;
+
+    /* Do we honour Range headers? */
+    bool ranges = true;
+
+    /* Answer with this status (and no file) if it isn't 200. */
+    int status = 200;
+
+    /* Drop the connection after this many bytes of the body; -1 never. */
+    std::int64_t fail_after = -1;
+
+    /* Send an HTML page with a 200 instead of the file, as mirrors with captchas do. */
+    bool html = false;
+
+    /* Which magic bytes the file starts with: pdf, epub, djvu or none. */
+    string kind = "pdf";
+
+    static file_spec parse(const string &query);
+
+    /* Fill buf with len bytes of the file, starting at offset. Deterministic. */
+    void fill(std::int64_t offset, char *buf, size_t len) const;
+
+    /* The MD5 of the whole file, as LibGen would put it in a URL. */
+    string md5() const;
+};
+
+/*
+ * A minimal HTTP/1.1 server for the downloader to fetch from: GET and HEAD,
+ * single byte ranges, keep-alive. Files under the root directory, if given,
+ * are served as they are, query string or not; other paths with a query
+ * string are synthetic files (see file_spec); /big is a default one.
+ */
+class server {
+public:
+    /* Port 0 picks a free one; see port(). */
+    explicit server(uint16_t port = 0, fs::path root = "");
+    ~server();
+
+    uint16_t port() const
+    {
+        return port_;
+    }
+
+    /* http://127.0.0.1:<port><path> */
+    string url(const string &path) const;
+
+    /* Serve from a background thread until stop() (or destruction). */
+    void start();
+    void stop();
+
+    /* Serve on this thread; never returns unless stopped from another. */
+    void run();
+
+    /* How many requests we have answered. */
+    size_t requests() const
+    {
+        return requests_;
+    }
+
+private:
+    void serve(int fd);
+
+    /* Answer a single request; returns false if the connection should be closed. */
+    bool respond(int fd, const string &request);
+
+    /* Send all of len, returning false if the peer went away. */
+    static bool send_all(int fd, const char *data, size_t len);
+
+    int listen_fd_;
+    uint16_t port_;
+    const fs::path root_;
+
+    std::atomic<bool> stop_{false};
+    std::atomic<size_t> requests_{0};
+
+    std::thread acceptor_;
+
+    /* Open connections, so that stop() can shut them down. */
+    std::mutex clients_mutex_;
+    std::set<int> clients_;
+    vector<std::thread> workers_;
+};
+
+/* ns bookwyrm::test */
+}
@@ -0,0 +1,25 @@
+#include <cstdlib>
+#include <fmt/format.h>
+
+#include "server.hpp"
+
+/*
+ * Serves the test directory and synthetic files for a debug build of
+ * bookwyrm to download from; see test/run.sh and the testsource plugin.
+ */
+int main(int argc, char *argv[])
+{
+    const uint16_t port = argc > 1 ? std::atoi(argv[1]) : 8000;
+    const fs::path root = argc > 2 ? argv[2] : ".";
+
+    try {
+        bookwyrm::test::server server(port, root);
+        fmt::print("serving {} on {}\n", root.string(), server.url("/"));
+        server.run();
+    } catch (const std::exception &err) {
+        fmt::print(stderr, "error: {}\n", err.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
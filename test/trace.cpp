@@ -0,0 +1,93 @@
+#include <thread>
+#include <sstream>
+#include <cstdlib>
+#include <fmt/format.h>
+
+#include "core/trace.hpp"
+#include "json.hpp"
+
+/*
+ * Records spans from a couple of threads, more than a ring holds on one of
+ * them, and checks that what is written is a Chrome trace with the newest
+ * of them in it, names cut short where they should be.
+ */
+
+using namespace core;
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const string &what)
+{
+    if (!ok) failures++;
+    fmt::print(stderr, "{:<48} {}\n", what, ok ? "ok" : "FAILED");
+}
+
+/* ns anonymous */
+}
+
+int main()
+{
+    constexpr int feeds = 100000;
+
+    { trace::span ignored("test", "before start"); }
+
+    trace::start();
+    trace::name_thread("main");
+
+    std::thread plugin([] {
+        trace::name_thread("plugin \"quoted\"");
+        for (int i = 0; i < feeds; i++) {
+            trace::span feed("plugin", "feed", fmt::format("{}", i));
+        }
+    });
+    plugin.join();
+
+    {
+        trace::span title("download", "Война и мир, Война и мир, Война и мир, Война и мир, Война и мир, Война и мир");
+        title.set_detail("done");
+    }
+    trace::instant("download", "first byte");
+
+    std::ostringstream os;
+    trace::write_chrome_trace(os);
+
+    json::value trace;
+    try {
+        trace = json::parse(os.str());
+        check(true, "trace is JSON");
+    } catch (const value_error &err) {
+        check(false, fmt::format("trace is JSON: {}", err.what()));
+        return EXIT_FAILURE;
+    }
+
+    size_t feed_count = 0;
+    bool before_start = false, newest_feed = false, instant = false, cut_title = false;
+    vector<string> thread_names;
+
+    for (const auto &e : trace["traceEvents"].elements()) {
+        const string ph = e["ph"].str(), name = e["name"].str();
+
+        if (ph == "M")
+            thread_names.push_back(e["args"]["name"].str());
+        else if (name == "before start")
+            before_start = true;
+        else if (name == "feed") {
+            feed_count++;
+            newest_feed |= e["args"]["detail"].str() == fmt::format("{}", feeds - 1);
+        } else if (name == "first byte")
+            instant = ph == "i";
+        else if (name.find("Война") == 0)
+            cut_title = name.length() < 100 && e["args"]["detail"].str() == "done" && e["dur"].number(-1) >= 0;
+    }
+
+    check(!before_start, "nothing recorded before start()");
+    check(thread_names == vector<string>{"main", "plugin \"quoted\""}, "threads named");
+    check(feed_count > 0 && feed_count < feeds, "older events overwritten");
+    check(newest_feed, "newest event kept");
+    check(instant, "instant event");
+    check(cut_title, "long names cut short");
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}